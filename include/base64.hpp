@@ -0,0 +1,496 @@
+#pragma once
+#ifndef BASE64_HPP
+#define BASE64_HPP
+
+
+#include "cfile.hpp"
+
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+
+// 'extra' namespace
+namespace xtr {
+
+namespace detail {
+
+constexpr char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                   "abcdefghijklmnopqrstuvwxyz"
+                                   "0123456789+/";
+
+constexpr unsigned char base64_invalid = 0xFF;
+constexpr unsigned char base64_space = 0xFE;
+constexpr unsigned char base64_padding = 0xFD;
+
+struct base64_tables {
+	// Two output characters for every 12 input bits, so six input bytes take four lookups
+	char pairs[4096][2];
+	unsigned char values[256];
+};
+
+inline base64_tables make_base64_tables() noexcept {
+
+	base64_tables result{};
+
+	for (unsigned i = 0; i < 4096; ++i) {
+		result.pairs[i][0] = base64_alphabet[i >> 6];
+		result.pairs[i][1] = base64_alphabet[i & 0x3F];
+	}
+
+	std::memset(result.values, base64_invalid, sizeof(result.values));
+
+	for (unsigned i = 0; i < 64; ++i) {
+		unsigned char character = static_cast<unsigned char>(base64_alphabet[i]);
+		result.values[character] = static_cast<unsigned char>(i);
+	}
+
+	result.values[static_cast<unsigned char>(' ')] = base64_space;
+	result.values[static_cast<unsigned char>('\t')] = base64_space;
+	result.values[static_cast<unsigned char>('\r')] = base64_space;
+	result.values[static_cast<unsigned char>('\n')] = base64_space;
+	result.values[static_cast<unsigned char>('=')] = base64_padding;
+
+	return result;
+}
+
+inline const base64_tables &get_base64_tables() noexcept {
+
+	static const base64_tables tables = make_base64_tables();
+
+	return tables;
+}
+
+#if defined(__SSSE3__)
+// Encodes the first 12 of 16 loaded bytes into 16 characters. The bytes of each three-byte group
+// are shuffled into place, the four 6-bit indices are moved to the low bits of their own bytes
+// with 16-bit multiplies, and each index is turned into a character by adding an offset looked
+// up from its range.
+[[nodiscard]] inline __m128i base64_encode16(__m128i input) noexcept {
+
+	input =
+	    _mm_shuffle_epi8(input, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+	__m128i high = _mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0FC0FC00)),
+	                               _mm_set1_epi32(0x04000040));
+	__m128i low = _mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003F03F0)),
+	                              _mm_set1_epi32(0x01000010));
+	__m128i indices = _mm_or_si128(high, low);
+
+	// 0 for 'a'-'z' and above, 1-12 for the digits and symbols, 13 for 'A'-'Z'
+	__m128i ranges = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	ranges = _mm_or_si128(
+	    ranges, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+	__m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	                                '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+	                                '/' - 63, 'A', 0, 0);
+
+	return _mm_add_epi8(_mm_shuffle_epi8(offsets, ranges), indices);
+}
+
+// Decodes 16 characters into the first 12 bytes of output, which must have room for 16. Returns
+// false, leaving output unspecified, if any character is not in the alphabet. Characters are
+// classified by a lookup on each nibble, and turned into their values by adding an offset looked
+// up by high nibble, with '/' told apart from '+' by an extra comparison.
+[[nodiscard]] inline bool base64_decode16(const unsigned char *input,
+                                          unsigned char *output) noexcept {
+
+	__m128i characters = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+	__m128i high_nibbles = _mm_and_si128(_mm_srli_epi32(characters, 4), _mm_set1_epi8(0x0F));
+	__m128i low_nibbles = _mm_and_si128(characters, _mm_set1_epi8(0x0F));
+
+	__m128i low_classes = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+	                                    0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	__m128i high_classes = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+	                                     0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	__m128i invalid = _mm_and_si128(_mm_shuffle_epi8(low_classes, low_nibbles),
+	                                _mm_shuffle_epi8(high_classes, high_nibbles));
+
+	if (_mm_movemask_epi8(_mm_cmpgt_epi8(invalid, _mm_setzero_si128())) != 0) {
+		return false;
+	}
+
+	__m128i offsets = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	__m128i slashes = _mm_cmpeq_epi8(characters, _mm_set1_epi8('/'));
+	__m128i values = _mm_add_epi8(
+	    characters, _mm_shuffle_epi8(offsets, _mm_add_epi8(slashes, high_nibbles)));
+
+	// Merge pairs of 6-bit values into 12 bits, then pairs of those into 24, and gather the bytes
+	__m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+	__m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+	__m128i bytes = _mm_shuffle_epi8(
+	    groups, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(output), bytes);
+
+	return true;
+}
+#endif
+
+} // namespace detail
+
+// Encodes everything written to it as base64 into an owned buffer that goes to the cfile with a
+// single fwrite when it fills up. With SSSE3, input is encoded 12 bytes at a time in vector
+// registers; otherwise, and for the tail, six bytes at a time through a table of character pairs.
+// finish() pads the last group, after which the writer can start on another blob. The cfile is
+// not owned and must outlive the writer.
+class base64_writer {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_size;
+	unsigned char m_pending[2];
+	std::size_t m_pending_size;
+
+	// Encodes count whole three-byte groups into output
+	static void encode_groups(const unsigned char *input, std::size_t count,
+	                          char *output) noexcept {
+
+		const detail::base64_tables &tables = detail::get_base64_tables();
+
+#if defined(__SSSE3__)
+		// Four groups at a time, while the 16-byte load stays within the input
+		for (; count >= 6; count -= 4, input += 12, output += 16) {
+
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(output), detail::base64_encode16(bytes));
+		}
+#endif
+
+		for (; count >= 2; count -= 2, input += 6, output += 8) {
+
+			std::uint64_t bits = 0;
+
+			for (std::size_t i = 0; i < 6; ++i) {
+				bits = (bits << 8) | input[i];
+			}
+
+			std::memcpy(output, tables.pairs[(bits >> 36) & 0xFFF], 2);
+			std::memcpy(output + 2, tables.pairs[(bits >> 24) & 0xFFF], 2);
+			std::memcpy(output + 4, tables.pairs[(bits >> 12) & 0xFFF], 2);
+			std::memcpy(output + 6, tables.pairs[bits & 0xFFF], 2);
+		}
+
+		if (count != 0) {
+
+			std::uint32_t bits = (static_cast<std::uint32_t>(input[0]) << 16)
+			                     | (static_cast<std::uint32_t>(input[1]) << 8) | input[2];
+
+			std::memcpy(output, tables.pairs[bits >> 12], 2);
+			std::memcpy(output + 2, tables.pairs[bits & 0xFFF], 2);
+		}
+	}
+
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+
+	explicit base64_writer(cfile &file, std::size_t capacity = default_capacity) noexcept :
+	    m_file{&file}, m_buffer{new (std::nothrow) char[capacity < 8 ? 8 : capacity]},
+	    m_capacity{m_buffer != nullptr ? (capacity < 8 ? 8 : capacity) : 0}, m_size{0},
+	    m_pending{}, m_pending_size{0} {}
+
+	base64_writer(const base64_writer &) = delete;
+
+	base64_writer(base64_writer &&other) noexcept :
+	    m_file{other.m_file}, m_buffer{std::move(other.m_buffer)},
+	    m_capacity{std::exchange(other.m_capacity, 0)}, m_size{std::exchange(other.m_size, 0)},
+	    m_pending{other.m_pending[0], other.m_pending[1]},
+	    m_pending_size{std::exchange(other.m_pending_size, 0)} {}
+
+	base64_writer &operator=(const base64_writer &) = delete;
+
+	base64_writer &operator=(base64_writer &&other) noexcept {
+
+		finish();
+
+		m_file = other.m_file;
+		m_buffer = std::move(other.m_buffer);
+		m_capacity = std::exchange(other.m_capacity, 0);
+		m_size = std::exchange(other.m_size, 0);
+		std::memcpy(m_pending, other.m_pending, sizeof(m_pending));
+		m_pending_size = std::exchange(other.m_pending_size, 0);
+
+		return *this;
+	}
+
+	~base64_writer() {
+		finish();
+	}
+
+	bool write(const void *data, std::size_t size) noexcept {
+
+		if (m_capacity == 0) {
+			return false;
+		}
+
+		const unsigned char *input = static_cast<const unsigned char *>(data);
+
+		if (m_pending_size != 0) {
+
+			unsigned char group[3] = {m_pending[0], m_pending[1], 0};
+
+			while (m_pending_size < 3 && size != 0) {
+				group[m_pending_size++] = *input++;
+				--size;
+			}
+
+			if (m_pending_size < 3) {
+				std::memcpy(m_pending, group, 2);
+				return true;
+			}
+
+			if (m_capacity - m_size < 4 && !flush()) {
+				return false;
+			}
+
+			encode_groups(group, 1, m_buffer.get() + m_size);
+			m_size += 4;
+			m_pending_size = 0;
+		}
+
+		while (size >= 3) {
+
+			std::size_t groups = (m_capacity - m_size) / 4;
+
+			if (groups == 0) {
+
+				if (!flush()) {
+					return false;
+				}
+
+				continue;
+			}
+
+			if (groups > size / 3) {
+				groups = size / 3;
+			}
+
+			encode_groups(input, groups, m_buffer.get() + m_size);
+
+			m_size += 4 * groups;
+			input += 3 * groups;
+			size -= 3 * groups;
+		}
+
+		std::memcpy(m_pending, input, size);
+		m_pending_size = size;
+
+		return true;
+	}
+
+	// Encodes and pads the final partial group, then flushes
+	bool finish() noexcept {
+
+		if (m_pending_size != 0) {
+
+			if (m_capacity - m_size < 4 && !flush()) {
+				return false;
+			}
+
+			unsigned char group[3] = {m_pending[0], 0, 0};
+
+			if (m_pending_size == 2) {
+				group[1] = m_pending[1];
+			}
+
+			char *output = m_buffer.get() + m_size;
+
+			encode_groups(group, 1, output);
+			output[3] = '=';
+
+			if (m_pending_size == 1) {
+				output[2] = '=';
+			}
+
+			m_size += 4;
+			m_pending_size = 0;
+		}
+
+		return flush();
+	}
+
+	// Hands complete groups to the cfile; this does not call cfile::fflush
+	bool flush() noexcept {
+
+		if (m_size == 0) {
+			return true;
+		}
+
+		std::size_t size = std::exchange(m_size, 0);
+
+		return m_file->fwrite(m_buffer.get(), 1, size) == size;
+	}
+};
+
+// Decodes base64 text from a cfile. Whitespace between characters is skipped, padding is optional
+// and decoding stops at the first '='. While the input is clean, 16 characters at a time are
+// decoded with SSSE3 and whole four-character groups with a single validity check otherwise. The
+// cfile is not owned and must outlive the reader.
+class base64_reader {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_begin;
+	std::size_t m_end;
+	std::uint32_t m_quad;
+	std::size_t m_quad_size;
+	unsigned char m_spill[3];
+	std::size_t m_spill_begin;
+	std::size_t m_spill_end;
+	bool m_done;
+	bool m_error;
+
+	// Flushes the bits of a complete or final partial group to output, keeping what does not fit
+	void emit(unsigned char *output, std::size_t &result, std::size_t size,
+	          std::size_t count) noexcept {
+
+		unsigned char bytes[3] = {static_cast<unsigned char>(m_quad >> 16),
+		                          static_cast<unsigned char>(m_quad >> 8),
+		                          static_cast<unsigned char>(m_quad)};
+
+		for (std::size_t i = 0; i < count; ++i) {
+
+			if (result < size) {
+				output[result++] = bytes[i];
+			}
+			else {
+				m_spill[m_spill_end++] = bytes[i];
+			}
+		}
+
+		m_quad = 0;
+		m_quad_size = 0;
+	}
+
+	// Handles a group left unfinished by padding or the end of input
+	void finish_group(unsigned char *output, std::size_t &result, std::size_t size) noexcept {
+
+		if (m_quad_size == 1) {
+			m_error = true;
+		}
+		else if (m_quad_size != 0) {
+			std::size_t count = m_quad_size - 1;
+			m_quad <<= 6 * (4 - m_quad_size);
+			emit(output, result, size, count);
+		}
+
+		m_done = true;
+	}
+
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+
+	explicit base64_reader(cfile &file, std::size_t capacity = default_capacity) noexcept :
+	    m_file{&file}, m_buffer{new (std::nothrow) char[capacity]},
+	    m_capacity{m_buffer != nullptr ? capacity : 0}, m_begin{0}, m_end{0}, m_quad{0},
+	    m_quad_size{0}, m_spill{}, m_spill_begin{0}, m_spill_end{0}, m_done{false},
+	    m_error{m_buffer == nullptr} {}
+
+	// Returns the number of decoded bytes stored, which is less than size only at the end of the
+	// data or on an error
+	std::size_t read(void *buffer, std::size_t size) noexcept {
+
+		const detail::base64_tables &tables = detail::get_base64_tables();
+
+		unsigned char *output = static_cast<unsigned char *>(buffer);
+		std::size_t result = 0;
+
+		while (result < size && m_spill_begin != m_spill_end) {
+			output[result++] = m_spill[m_spill_begin++];
+		}
+
+		if (m_spill_begin == m_spill_end) {
+			m_spill_begin = 0;
+			m_spill_end = 0;
+		}
+
+		while (result < size && !m_done && !m_error) {
+
+			if (m_begin == m_end) {
+
+				m_begin = 0;
+				m_end = m_file->fread(m_buffer.get(), 1, m_capacity);
+
+				if (m_end == 0) {
+					finish_group(output, result, size);
+					break;
+				}
+			}
+
+			const unsigned char *input = reinterpret_cast<const unsigned char *>(m_buffer.get());
+
+#if defined(__SSSE3__)
+			while (m_quad_size == 0 && m_end - m_begin >= 16 && size - result >= 16
+			       && detail::base64_decode16(input + m_begin, output + result)) {
+				result += 12;
+				m_begin += 16;
+			}
+#endif
+
+			while (m_quad_size == 0 && m_end - m_begin >= 4 && size - result >= 3) {
+
+				unsigned first = tables.values[input[m_begin]];
+				unsigned second = tables.values[input[m_begin + 1]];
+				unsigned third = tables.values[input[m_begin + 2]];
+				unsigned fourth = tables.values[input[m_begin + 3]];
+
+				if ((first | second | third | fourth) >= 64) {
+					break;
+				}
+
+				std::uint32_t bits = (first << 18) | (second << 12) | (third << 6) | fourth;
+
+				output[result] = static_cast<unsigned char>(bits >> 16);
+				output[result + 1] = static_cast<unsigned char>(bits >> 8);
+				output[result + 2] = static_cast<unsigned char>(bits);
+
+				result += 3;
+				m_begin += 4;
+			}
+
+			if (m_begin == m_end || result == size) {
+				continue;
+			}
+
+			unsigned value = tables.values[input[m_begin++]];
+
+			if (value < 64) {
+
+				m_quad = (m_quad << 6) | value;
+
+				if (++m_quad_size == 4) {
+					emit(output, result, size, 3);
+				}
+			}
+			else if (value == detail::base64_padding) {
+				finish_group(output, result, size);
+			}
+			else if (value != detail::base64_space) {
+				m_error = true;
+			}
+		}
+
+		return result;
+	}
+
+	[[nodiscard]] bool error() noexcept {
+		return m_error || m_file->ferror() != 0;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // BASE64_HPP
@@ -0,0 +1,344 @@
+#pragma once
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+
+#include "cfile.hpp"
+#include "platform.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Caches fixed-size pages of one or more files in a fixed set of frames. pin() returns the page in
+// memory, reading it with one positional read on a miss, and keeps it resident until the matching
+// unpin(). Victims are chosen with the CLOCK algorithm: a hand sweeps the frames, giving each
+// recently used page a second chance. Dirty pages are written back when evicted, and flush()
+// writes all of them sorted by position, merging neighbouring pages into single writes. Misses
+// read and write back outside the pool lock, with the frame marked as loading so that other
+// threads pinning the same page wait for it instead of reading it again.
+//
+// Attached files should be opened with mode::read | mode::binary | mode::extended and not used
+// through stdio while attached. They are not owned and must outlive the pool. All methods are
+// thread-safe; a pinned page may be used without the pool lock, but concurrent writers to the
+// same page need their own synchronisation.
+class buffer_pool {
+private:
+	struct frame {
+		std::uint64_t page;
+		std::uint32_t file;
+		std::uint32_t pins;
+		bool valid;
+		bool dirty;
+		bool referenced;
+		bool loading;
+	};
+
+	std::vector<cfile *> m_files;
+	std::unique_ptr<char[]> m_memory;
+	std::vector<frame> m_frames;
+	std::unordered_map<std::uint64_t, std::size_t> m_table;
+	std::size_t m_page_size;
+	std::size_t m_hand;
+	std::mutex m_mutex;
+	std::condition_variable m_loaded;
+	bool m_error;
+
+	// Up to 2^16 files of 2^48 pages each
+	[[nodiscard]] static std::uint64_t make_key(std::uint32_t file, std::uint64_t page) noexcept {
+		return static_cast<std::uint64_t>(file) << 48 | page;
+	}
+
+	[[nodiscard]] char *data(std::size_t index) const noexcept {
+		return m_memory.get() + index * m_page_size;
+	}
+
+	bool write_back(std::size_t index) noexcept {
+
+		frame &victim = m_frames[index];
+
+		if (platform::pwrite(*m_files[victim.file], data(index), m_page_size,
+		                     victim.page * m_page_size)
+		    != m_page_size) {
+			m_error = true;
+			return false;
+		}
+
+		victim.dirty = false;
+
+		return true;
+	}
+
+	// Sweeps at most twice around the clock for an unpinned frame. Returns the number of frames
+	// if every frame is pinned.
+	[[nodiscard]] std::size_t find_victim() noexcept {
+
+		for (std::size_t step = 0; step < 2 * m_frames.size(); ++step) {
+
+			std::size_t index = m_hand;
+			frame &candidate = m_frames[index];
+
+			m_hand = m_hand + 1 == m_frames.size() ? 0 : m_hand + 1;
+
+			if (!candidate.valid) {
+				return index;
+			}
+
+			if (candidate.pins != 0) {
+				continue;
+			}
+
+			if (candidate.referenced) {
+				candidate.referenced = false;
+				continue;
+			}
+
+			return index;
+		}
+
+		return m_frames.size();
+	}
+
+public:
+	static constexpr std::size_t default_page_size = 4096;
+	static constexpr std::size_t default_frames = 1024;
+
+	explicit buffer_pool(std::size_t page_size = default_page_size,
+	                     std::size_t frames = default_frames) :
+	    m_memory{new (std::nothrow) char[page_size * frames]},
+	    m_frames(m_memory != nullptr ? frames : 0, frame{0, 0, 0, false, false, false, false}),
+	    m_page_size{page_size}, m_hand{0}, m_error{m_memory == nullptr} {
+		m_table.reserve(m_frames.size());
+	}
+
+	buffer_pool(const buffer_pool &) = delete;
+
+	buffer_pool &operator=(const buffer_pool &) = delete;
+
+	~buffer_pool() {
+		flush();
+	}
+
+	// Returns the id used to refer to file in pin()
+	std::uint32_t attach(cfile &file) {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		m_files.push_back(&file);
+
+		return static_cast<std::uint32_t>(m_files.size() - 1);
+	}
+
+	[[nodiscard]] std::size_t page_size() const noexcept {
+		return m_page_size;
+	}
+
+	// Returns the contents of the page, or nullptr if every frame is pinned, a dirty victim could
+	// not be written back or the page could not be read. Bytes past the end of the file read as
+	// zeros.
+	char *pin(std::uint32_t file, std::uint64_t page) {
+
+		assert(file < m_files.size());
+
+		std::unique_lock<std::mutex> lock{m_mutex};
+
+		std::uint64_t key = make_key(file, page);
+		std::size_t index;
+
+		for (;;) {
+
+			auto found = m_table.find(key);
+
+			if (found == m_table.end()) {
+				index = find_victim();
+				break;
+			}
+
+			frame &hit = m_frames[found->second];
+
+			// Another thread is reading the page; look again once it is done, as it may fail
+			if (hit.loading) {
+				m_loaded.wait(lock);
+				continue;
+			}
+
+			++hit.pins;
+			hit.referenced = true;
+
+			return data(found->second);
+		}
+
+		if (index == m_frames.size()) {
+			return nullptr;
+		}
+
+		// The pin keeps the frame from being chosen again while the lock is released
+		frame &target = m_frames[index];
+		char *result = data(index);
+
+		target.pins = 1;
+		target.loading = true;
+
+		// Claim the page before any unlock, so that another pin of it waits for this frame
+		// instead of loading a second copy
+		m_table.emplace(key, index);
+
+		if (target.valid && target.dirty) {
+
+			cfile &owner = *m_files[target.file];
+			std::uint64_t offset = target.page * m_page_size;
+
+			lock.unlock();
+			bool written = platform::pwrite(owner, result, m_page_size, offset) == m_page_size;
+			lock.lock();
+
+			if (!written) {
+				m_error = true;
+				m_table.erase(key);
+				target.pins = 0;
+				target.loading = false;
+				m_loaded.notify_all();
+				return nullptr;
+			}
+
+			target.dirty = false;
+		}
+
+		if (target.valid) {
+			m_table.erase(make_key(target.file, target.page));
+		}
+
+		target = frame{page, file, 1, true, false, true, true};
+
+		cfile &source = *m_files[file];
+		std::uint64_t offset = page * m_page_size;
+
+		lock.unlock();
+
+		std::size_t read = platform::pread(source, result, m_page_size, offset);
+
+		// A short read is only the end of the file if the file really ends there
+		bool failed = read < m_page_size && offset + read < platform::file_size(source);
+
+		if (!failed && read < m_page_size) {
+			std::memset(result + read, 0, m_page_size - read);
+		}
+
+		lock.lock();
+
+		target.loading = false;
+		m_loaded.notify_all();
+
+		if (failed) {
+			m_error = true;
+			m_table.erase(key);
+			target.valid = false;
+			target.pins = 0;
+			return nullptr;
+		}
+
+		return result;
+	}
+
+	// Releases a page returned by pin(). Pass dirty if the page was modified.
+	void unpin(const char *page, bool dirty = false) noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		std::size_t index = static_cast<std::size_t>(page - m_memory.get()) / m_page_size;
+		frame &target = m_frames[index];
+
+		assert(target.valid && target.pins != 0);
+
+		--target.pins;
+		target.dirty = target.dirty || dirty;
+	}
+
+	// Writes every dirty page back in file and page order, one write per run of consecutive
+	// pages. Pages may be pinned meanwhile, but should not be modified until this returns.
+	bool flush() {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		std::vector<std::size_t> dirty;
+
+		for (std::size_t i = 0; i < m_frames.size(); ++i) {
+
+			if (m_frames[i].valid && m_frames[i].dirty && !m_frames[i].loading) {
+				dirty.push_back(i);
+			}
+		}
+
+		std::sort(dirty.begin(), dirty.end(), [&](std::size_t lhs, std::size_t rhs) {
+			return make_key(m_frames[lhs].file, m_frames[lhs].page)
+			       < make_key(m_frames[rhs].file, m_frames[rhs].page);
+		});
+
+		std::string run;
+
+		for (std::size_t begin = 0, end; begin < dirty.size(); begin = end) {
+
+			const frame &first = m_frames[dirty[begin]];
+
+			for (end = begin + 1; end < dirty.size(); ++end) {
+
+				const frame &next = m_frames[dirty[end]];
+
+				if (next.file != first.file || next.page != first.page + (end - begin)) {
+					break;
+				}
+			}
+
+			if (end - begin == 1) {
+				write_back(dirty[begin]);
+				continue;
+			}
+
+			run.resize((end - begin) * m_page_size);
+
+			for (std::size_t i = begin; i < end; ++i) {
+				std::memcpy(&run[(i - begin) * m_page_size], data(dirty[i]), m_page_size);
+			}
+
+			if (platform::pwrite(*m_files[first.file], run.data(), run.size(),
+			                     first.page * m_page_size)
+			    != run.size()) {
+				m_error = true;
+				continue;
+			}
+
+			for (std::size_t i = begin; i < end; ++i) {
+				m_frames[dirty[i]].dirty = false;
+			}
+		}
+
+		return !m_error;
+	}
+
+	// True if memory could not be allocated, a read failed or a write-back has failed
+	[[nodiscard]] bool error() noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		return m_error;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // BUFFER_POOL_HPP
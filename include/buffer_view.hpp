@@ -0,0 +1,113 @@
+#pragma once
+#ifndef BUFFER_VIEW_HPP
+#define BUFFER_VIEW_HPP
+
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Non-owning view of a contiguous range of bytes, usable in C++14 code in place of
+// std::string_view. The viewed memory must outlive the view.
+class buffer_view {
+private:
+	const char *m_data;
+	std::size_t m_size;
+
+public:
+	constexpr buffer_view() noexcept : m_data{nullptr}, m_size{0} {}
+
+	constexpr buffer_view(const char *data, std::size_t size) noexcept :
+	    m_data{data}, m_size{size} {}
+
+	buffer_view(const char *string) noexcept : m_data{string}, m_size{std::strlen(string)} {}
+
+	buffer_view(std::nullptr_t) = delete;
+
+	[[nodiscard]] constexpr const char *data() const noexcept {
+		return m_data;
+	}
+
+	[[nodiscard]] constexpr std::size_t size() const noexcept {
+		return m_size;
+	}
+
+	[[nodiscard]] constexpr bool empty() const noexcept {
+		return m_size == 0;
+	}
+
+	[[nodiscard]] constexpr const char *begin() const noexcept {
+		return m_data;
+	}
+
+	[[nodiscard]] constexpr const char *end() const noexcept {
+		return m_data + m_size;
+	}
+
+	[[nodiscard]] const char &operator[](std::size_t index) const noexcept {
+
+		assert(index < m_size);
+
+		return m_data[index];
+	}
+
+	[[nodiscard]] buffer_view substr(std::size_t position, std::size_t count) const noexcept {
+
+		assert(position <= m_size);
+
+		if (count > m_size - position) {
+			count = m_size - position;
+		}
+
+		return buffer_view{m_data + position, count};
+	}
+
+	void remove_prefix(std::size_t count) noexcept {
+
+		assert(count <= m_size);
+
+		m_data += count;
+		m_size -= count;
+	}
+
+	void remove_suffix(std::size_t count) noexcept {
+
+		assert(count <= m_size);
+
+		m_size -= count;
+	}
+
+	[[nodiscard]] int compare(buffer_view other) const noexcept {
+
+		std::size_t length = m_size < other.m_size ? m_size : other.m_size;
+
+		int result = length == 0 ? 0 : std::memcmp(m_data, other.m_data, length);
+
+		if (result == 0 && m_size != other.m_size) {
+			result = m_size < other.m_size ? -1 : 1;
+		}
+
+		return result;
+	}
+
+	[[nodiscard]] friend bool operator==(buffer_view lhs, buffer_view rhs) noexcept {
+		return lhs.m_size == rhs.m_size && lhs.compare(rhs) == 0;
+	}
+
+	[[nodiscard]] friend bool operator!=(buffer_view lhs, buffer_view rhs) noexcept {
+		return !(lhs == rhs);
+	}
+
+	[[nodiscard]] friend bool operator<(buffer_view lhs, buffer_view rhs) noexcept {
+		return lhs.compare(rhs) < 0;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // BUFFER_VIEW_HPP
@@ -0,0 +1,196 @@
+#pragma once
+#ifndef BUFFERED_READER_HPP
+#define BUFFERED_READER_HPP
+
+
+#include "buffer_view.hpp"
+#include "cfile.hpp"
+
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Read buffer over a cfile that supports arbitrary lookahead. Bytes stay in the buffer until
+// they are consumed, so parsers can inspect headers in place instead of copying them out.
+// The cfile is not owned and must outlive the reader.
+class buffered_reader {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_begin;
+	std::size_t m_end;
+
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+
+	explicit buffered_reader(cfile &file, std::size_t capacity = default_capacity) noexcept :
+	    m_file{&file}, m_buffer{new (std::nothrow) char[capacity]},
+	    m_capacity{m_buffer != nullptr ? capacity : 0}, m_begin{0}, m_end{0} {}
+
+	buffered_reader(const buffered_reader &) = delete;
+
+	buffered_reader(buffered_reader &&other) noexcept :
+	    m_file{other.m_file}, m_buffer{std::move(other.m_buffer)},
+	    m_capacity{std::exchange(other.m_capacity, 0)}, m_begin{std::exchange(other.m_begin, 0)},
+	    m_end{std::exchange(other.m_end, 0)} {}
+
+	buffered_reader &operator=(const buffered_reader &) = delete;
+
+	buffered_reader &operator=(buffered_reader &&other) noexcept {
+
+		m_file = other.m_file;
+		m_buffer = std::move(other.m_buffer);
+		m_capacity = std::exchange(other.m_capacity, 0);
+		m_begin = std::exchange(other.m_begin, 0);
+		m_end = std::exchange(other.m_end, 0);
+
+		return *this;
+	}
+
+	[[nodiscard]] cfile &file() const noexcept {
+		return *m_file;
+	}
+
+	[[nodiscard]] std::size_t size() const noexcept {
+		return m_end - m_begin;
+	}
+
+	[[nodiscard]] std::size_t capacity() const noexcept {
+		return m_capacity;
+	}
+
+	[[nodiscard]] bool empty() const noexcept {
+		return m_begin == m_end;
+	}
+
+	// Returns the bytes currently buffered without reading from the file
+	[[nodiscard]] buffer_view view() const noexcept {
+		return buffer_view{m_buffer.get() + m_begin, m_end - m_begin};
+	}
+
+	// Returns a view of at least count buffered bytes, reading and growing the buffer as needed.
+	// The view is shorter than count only at end of file, on a read error or if growing failed.
+	[[nodiscard]] buffer_view peek(std::size_t count) noexcept {
+
+		if (count > m_capacity) {
+			reserve(count);
+		}
+
+		while (size() < count && fill() != 0) {
+		}
+
+		return view();
+	}
+
+	void consume(std::size_t count) noexcept {
+
+		assert(count <= size());
+
+		m_begin += count;
+
+		if (m_begin == m_end) {
+			m_begin = 0;
+			m_end = 0;
+		}
+	}
+
+	// Moves unconsumed bytes to the front and reads as much as fits. Returns the number of bytes
+	// read, which is zero at end of file, on a read error or when the buffer is already full.
+	std::size_t fill() noexcept {
+
+		if (m_begin != 0) {
+			std::memmove(m_buffer.get(), m_buffer.get() + m_begin, m_end - m_begin);
+			m_end -= m_begin;
+			m_begin = 0;
+		}
+
+		if (m_end == m_capacity) {
+			return 0;
+		}
+
+		std::size_t result = m_file->fread(m_buffer.get() + m_end, 1, m_capacity - m_end);
+		m_end += result;
+
+		return result;
+	}
+
+	// Grows the buffer to hold at least capacity bytes, keeping unconsumed bytes
+	bool reserve(std::size_t capacity) noexcept {
+
+		if (capacity <= m_capacity) {
+			return true;
+		}
+
+		std::unique_ptr<char[]> buffer{new (std::nothrow) char[capacity]};
+
+		if (buffer == nullptr) {
+			return false;
+		}
+
+		if (m_end != m_begin) {
+			std::memcpy(buffer.get(), m_buffer.get() + m_begin, m_end - m_begin);
+		}
+
+		m_end -= m_begin;
+		m_begin = 0;
+		m_buffer = std::move(buffer);
+		m_capacity = capacity;
+
+		return true;
+	}
+
+	// Copies up to count bytes out, draining the buffer first and then reading large remainders
+	// straight from the file
+	std::size_t read(void *buffer, std::size_t count) noexcept {
+
+		char *output = static_cast<char *>(buffer);
+		std::size_t result = size() < count ? size() : count;
+
+		if (result != 0) {
+			std::memcpy(output, m_buffer.get() + m_begin, result);
+			consume(result);
+		}
+
+		if (result == count) {
+			return result;
+		}
+
+		if (count - result >= m_capacity) {
+			return result + m_file->fread(output + result, 1, count - result);
+		}
+
+		fill();
+
+		std::size_t remaining = size() < count - result ? size() : count - result;
+
+		if (remaining != 0) {
+			std::memcpy(output + result, m_buffer.get() + m_begin, remaining);
+			consume(remaining);
+		}
+
+		return result + remaining;
+	}
+
+	// Returns true once the buffer is drained and the file has reached end of file
+	[[nodiscard]] bool eof() noexcept {
+		return empty() && m_file->feof() != 0;
+	}
+
+	[[nodiscard]] bool error() noexcept {
+		return m_file->ferror() != 0;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // BUFFERED_READER_HPP
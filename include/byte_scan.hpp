@@ -0,0 +1,182 @@
+#pragma once
+#ifndef BYTE_SCAN_HPP
+#define BYTE_SCAN_HPP
+
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XTR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Bitmask helpers shared by the text scanners. A 64-byte block is classified at once into one
+// bit per byte, so scanners can walk structural characters with count-trailing-zeros instead of
+// testing every byte.
+namespace detail {
+
+constexpr std::size_t scan_block_size = 64;
+
+// Bit i is set if block[i] == value
+[[nodiscard]] inline std::uint64_t equal_mask(const char *block, char value) noexcept {
+
+#if defined(XTR_SSE2)
+	__m128i needle = _mm_set1_epi8(value);
+	std::uint64_t result = 0;
+
+	for (int i = 0; i < 4; ++i) {
+
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+		unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)));
+
+		result |= static_cast<std::uint64_t>(bits) << (16 * i);
+	}
+
+	return result;
+#else
+	std::uint64_t result = 0;
+
+	for (std::size_t i = 0; i < scan_block_size; ++i) {
+		result |= static_cast<std::uint64_t>(block[i] == value) << i;
+	}
+
+	return result;
+#endif
+}
+
+// Bit i is set if an odd number of bits at or below i are set, turning quote positions into a
+// mask of the bytes between opening and closing quotes
+[[nodiscard]] inline std::uint64_t prefix_xor(std::uint64_t bits) noexcept {
+
+	bits ^= bits << 1;
+	bits ^= bits << 2;
+	bits ^= bits << 4;
+	bits ^= bits << 8;
+	bits ^= bits << 16;
+	bits ^= bits << 32;
+
+	return bits;
+}
+
+// Index of the lowest set bit; bits must not be zero
+[[nodiscard]] inline unsigned trailing_zeros(std::uint64_t bits) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+	return static_cast<unsigned>(__builtin_ctzll(bits));
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return static_cast<unsigned>(index);
+#else
+	unsigned result = 0;
+
+	while ((bits & 1) == 0) {
+		bits >>= 1;
+		++result;
+	}
+
+	return result;
+#endif
+}
+
+// Index of the first byte with its high bit set, or size if every byte is ASCII
+[[nodiscard]] inline std::size_t ascii_prefix(const char *data, std::size_t size) noexcept {
+
+	std::size_t i = 0;
+
+#if defined(XTR_SSE2)
+	for (; i + 64 <= size; i += 64) {
+
+		const __m128i *block = reinterpret_cast<const __m128i *>(data + i);
+		__m128i low = _mm_or_si128(_mm_loadu_si128(block), _mm_loadu_si128(block + 1));
+		__m128i high = _mm_or_si128(_mm_loadu_si128(block + 2), _mm_loadu_si128(block + 3));
+
+		if (_mm_movemask_epi8(_mm_or_si128(low, high)) != 0) {
+			break;
+		}
+	}
+
+	for (; i + 16 <= size; i += 16) {
+
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(bytes));
+
+		if (bits != 0) {
+			return i + trailing_zeros(bits);
+		}
+	}
+#else
+	for (; i + 8 <= size; i += 8) {
+
+		std::uint64_t word;
+		std::memcpy(&word, data + i, sizeof(word));
+
+		if ((word & 0x8080808080808080ull) != 0) {
+			break;
+		}
+	}
+#endif
+
+	for (; i < size; ++i) {
+
+		if ((static_cast<unsigned char>(data[i]) & 0x80) != 0) {
+			return i;
+		}
+	}
+
+	return size;
+}
+
+// Index of the first byte equal to any of the four values, or size if there is none
+[[nodiscard]] inline std::size_t find_first_of(const char *data, std::size_t size, char first,
+                                               char second, char third, char fourth) noexcept {
+
+	std::size_t i = 0;
+
+#if defined(XTR_SSE2)
+	__m128i first_needle = _mm_set1_epi8(first);
+	__m128i second_needle = _mm_set1_epi8(second);
+	__m128i third_needle = _mm_set1_epi8(third);
+	__m128i fourth_needle = _mm_set1_epi8(fourth);
+
+	for (; i + 16 <= size; i += 16) {
+
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		__m128i first_matches =
+		    _mm_or_si128(_mm_cmpeq_epi8(bytes, first_needle), _mm_cmpeq_epi8(bytes, second_needle));
+		__m128i second_matches =
+		    _mm_or_si128(_mm_cmpeq_epi8(bytes, third_needle), _mm_cmpeq_epi8(bytes, fourth_needle));
+		unsigned bits = static_cast<unsigned>(
+		    _mm_movemask_epi8(_mm_or_si128(first_matches, second_matches)));
+
+		if (bits != 0) {
+			return i + trailing_zeros(bits);
+		}
+	}
+#endif
+
+	for (; i < size; ++i) {
+
+		if (data[i] == first || data[i] == second || data[i] == third || data[i] == fourth) {
+			return i;
+		}
+	}
+
+	return size;
+}
+
+} // namespace detail
+
+} // namespace xtr
+
+
+#endif // BYTE_SCAN_HPP
@@ -11,6 +11,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 
 
 #ifdef _MSC_VER
@@ -23,6 +24,89 @@
 // 'extra' namespace
 namespace xtr {
 
+namespace detail {
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) \
+    && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool native_little_endian = false;
+#else
+constexpr bool native_little_endian = true;
+#endif
+
+template <std::size_t Size>
+struct unsigned_of;
+
+template <>
+struct unsigned_of<1> {
+	using type = std::uint8_t;
+};
+
+template <>
+struct unsigned_of<2> {
+	using type = std::uint16_t;
+};
+
+template <>
+struct unsigned_of<4> {
+	using type = std::uint32_t;
+};
+
+template <>
+struct unsigned_of<8> {
+	using type = std::uint64_t;
+};
+
+[[nodiscard]] inline std::uint8_t byteswap(std::uint8_t value) noexcept {
+	return value;
+}
+
+[[nodiscard]] inline std::uint16_t byteswap(std::uint16_t value) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_bswap16(value);
+#else
+	return static_cast<std::uint16_t>((value >> 8) | (value << 8));
+#endif
+}
+
+[[nodiscard]] inline std::uint32_t byteswap(std::uint32_t value) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_bswap32(value);
+#else
+	return ((value & 0xFF000000u) >> 24) | ((value & 0x00FF0000u) >> 8)
+	       | ((value & 0x0000FF00u) << 8) | ((value & 0x000000FFu) << 24);
+#endif
+}
+
+[[nodiscard]] inline std::uint64_t byteswap(std::uint64_t value) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_bswap64(value);
+#else
+	return (static_cast<std::uint64_t>(byteswap(static_cast<std::uint32_t>(value))) << 32)
+	       | byteswap(static_cast<std::uint32_t>(value >> 32));
+#endif
+}
+
+// Copies count values from source to destination reversing the bytes of each one. The plain
+// loop over fixed-width integers is what compilers turn into vector shuffles.
+template <typename Type>
+void byteswap_copy(Type *destination, const Type *source, std::size_t count) noexcept {
+
+	using unsigned_type = typename unsigned_of<sizeof(Type)>::type;
+
+	unsigned char *output = reinterpret_cast<unsigned char *>(destination);
+	const unsigned char *input = reinterpret_cast<const unsigned char *>(source);
+
+	for (std::size_t i = 0; i < count; ++i) {
+
+		unsigned_type bits;
+		std::memcpy(&bits, input + i * sizeof(Type), sizeof(Type));
+		bits = byteswap(bits);
+		std::memcpy(output + i * sizeof(Type), &bits, sizeof(Type));
+	}
+}
+
+} // namespace detail
+
 class cfile {
 private:
 	std::FILE *m_stream;
@@ -97,6 +181,57 @@ private:
 		return nullptr;
 	}
 
+	template <typename Type>
+	static constexpr bool is_swappable() noexcept {
+		return (std::is_arithmetic<Type>::value || std::is_enum<Type>::value)
+		       && (sizeof(Type) == 1 || sizeof(Type) == 2 || sizeof(Type) == 4
+		           || sizeof(Type) == 8);
+	}
+
+	template <typename Type>
+	std::size_t write_ordered(const Type *buffer, std::size_t count, bool little_endian) noexcept {
+
+		static_assert(is_swappable<Type>(), "type must be an arithmetic or enum type");
+
+		if (sizeof(Type) == 1 || little_endian == detail::native_little_endian) {
+			return fwrite(buffer, count);
+		}
+
+		constexpr std::size_t chunk_size = 4096 / sizeof(Type);
+
+		Type chunk[chunk_size];
+		std::size_t result = 0;
+
+		while (result < count) {
+
+			std::size_t size = count - result < chunk_size ? count - result : chunk_size;
+			detail::byteswap_copy(chunk, buffer + result, size);
+
+			std::size_t written = fwrite(chunk, size);
+			result += written;
+
+			if (written != size) {
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	template <typename Type>
+	std::size_t read_ordered(Type *buffer, std::size_t count, bool little_endian) noexcept {
+
+		static_assert(is_swappable<Type>(), "type must be an arithmetic or enum type");
+
+		std::size_t result = fread(buffer, count);
+
+		if (sizeof(Type) != 1 && little_endian != detail::native_little_endian) {
+			detail::byteswap_copy(buffer, buffer, result);
+		}
+
+		return result;
+	}
+
 public:
 	explicit cfile() noexcept = default;
 
@@ -279,6 +414,48 @@ public:
 		return fwrite(buffer, sizeof(Type), Size);
 	}
 
+	// Binary input/output
+
+	template <typename Type>
+	std::size_t write_le(const Type &value) noexcept {
+		return write_ordered(&value, 1, true);
+	}
+
+	template <typename Type>
+	std::size_t write_le(const Type *buffer, std::size_t count) noexcept {
+		return write_ordered(buffer, count, true);
+	}
+
+	template <typename Type>
+	std::size_t write_be(const Type &value) noexcept {
+		return write_ordered(&value, 1, false);
+	}
+
+	template <typename Type>
+	std::size_t write_be(const Type *buffer, std::size_t count) noexcept {
+		return write_ordered(buffer, count, false);
+	}
+
+	template <typename Type>
+	std::size_t read_le(Type &value) noexcept {
+		return read_ordered(&value, 1, true);
+	}
+
+	template <typename Type>
+	std::size_t read_le(Type *buffer, std::size_t count) noexcept {
+		return read_ordered(buffer, count, true);
+	}
+
+	template <typename Type>
+	std::size_t read_be(Type &value) noexcept {
+		return read_ordered(&value, 1, false);
+	}
+
+	template <typename Type>
+	std::size_t read_be(Type *buffer, std::size_t count) noexcept {
+		return read_ordered(buffer, count, false);
+	}
+
 	// Unformatted input/output
 
 	[[nodiscard]] int fgetc() noexcept {
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef CRC32_HPP
+#define CRC32_HPP
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+// 'extra' namespace
+namespace xtr {
+
+namespace detail {
+
+struct crc32_tables {
+	std::uint32_t values[8][256];
+};
+
+inline crc32_tables make_crc32_tables() noexcept {
+
+	crc32_tables result{};
+
+	for (std::uint32_t i = 0; i < 256; ++i) {
+
+		std::uint32_t crc = i;
+
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+		}
+
+		result.values[0][i] = crc;
+	}
+
+	for (std::uint32_t i = 0; i < 256; ++i) {
+		for (int table = 1; table < 8; ++table) {
+			std::uint32_t previous = result.values[table - 1][i];
+			result.values[table][i] = (previous >> 8) ^ result.values[0][previous & 0xFF];
+		}
+	}
+
+	return result;
+}
+
+inline const crc32_tables &get_crc32_tables() noexcept {
+
+	static const crc32_tables tables = make_crc32_tables();
+
+	return tables;
+}
+
+} // namespace detail
+
+// CRC-32 as used by zlib and Ethernet, computed eight bytes per step. Pass the previous result as
+// crc to continue a checksum over several buffers.
+[[nodiscard]] inline std::uint32_t crc32(const void *data, std::size_t size,
+                                         std::uint32_t crc = 0) noexcept {
+
+	const std::uint32_t(*tables)[256] = detail::get_crc32_tables().values;
+	const unsigned char *input = static_cast<const unsigned char *>(data);
+
+	crc = ~crc;
+
+	for (; size >= 8; size -= 8, input += 8) {
+
+		std::uint32_t low = crc ^ (static_cast<std::uint32_t>(input[0])
+		                           | static_cast<std::uint32_t>(input[1]) << 8
+		                           | static_cast<std::uint32_t>(input[2]) << 16
+		                           | static_cast<std::uint32_t>(input[3]) << 24);
+
+		crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF]
+		      ^ tables[4][low >> 24] ^ tables[3][input[4]] ^ tables[2][input[5]]
+		      ^ tables[1][input[6]] ^ tables[0][input[7]];
+	}
+
+	for (; size != 0; --size, ++input) {
+		crc = (crc >> 8) ^ tables[0][(crc ^ *input) & 0xFF];
+	}
+
+	return ~crc;
+}
+
+} // namespace xtr
+
+
+#endif // CRC32_HPP
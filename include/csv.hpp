@@ -0,0 +1,549 @@
+#pragma once
+#ifndef CSV_HPP
+#define CSV_HPP
+
+
+#include "buffer_view.hpp"
+#include "buffered_reader.hpp"
+#include "byte_scan.hpp"
+#include "cfile.hpp"
+
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Fields of one record. Views point into the reader's buffers and stay valid until the next call
+// to csv_reader::next().
+class csv_row {
+private:
+	std::vector<buffer_view> m_fields;
+
+	friend class csv_reader;
+
+public:
+	[[nodiscard]] std::size_t size() const noexcept {
+		return m_fields.size();
+	}
+
+	[[nodiscard]] bool empty() const noexcept {
+		return m_fields.empty();
+	}
+
+	[[nodiscard]] buffer_view operator[](std::size_t index) const noexcept {
+		return m_fields[index];
+	}
+
+	[[nodiscard]] const buffer_view *begin() const noexcept {
+		return m_fields.data();
+	}
+
+	[[nodiscard]] const buffer_view *end() const noexcept {
+		return m_fields.data() + m_fields.size();
+	}
+};
+
+// Reads CSV or TSV records with RFC 4180 quoting. Buffered input is classified 64 bytes at a time
+// into delimiter, quote and newline bitmasks; a prefix XOR over the quote bits masks out quoted
+// regions, leaving the field separators to be walked bit by bit. Fields are returned as views
+// into the buffer, and only quoted fields containing doubled quotes are copied, into a scratch
+// buffer reused across rows. CRLF line endings are accepted.
+class csv_reader {
+private:
+	buffered_reader m_reader;
+	std::vector<std::size_t> m_structurals;
+	std::vector<char> m_scratch;
+	std::size_t m_offset;
+	std::size_t m_cursor;
+	std::size_t m_scanned;
+	bool m_in_quote;
+	bool m_final;
+	bool m_quoting;
+	char m_delimiter;
+
+	void scan_block(const char *block, std::size_t base, std::uint64_t valid) noexcept {
+
+		std::uint64_t quotes = m_quoting ? detail::equal_mask(block, '"') & valid : 0;
+		std::uint64_t inside = detail::prefix_xor(quotes) ^ (m_in_quote ? ~std::uint64_t{0} : 0);
+
+		m_in_quote = (inside >> 63) != 0;
+
+		std::uint64_t structurals =
+		    (detail::equal_mask(block, m_delimiter) | detail::equal_mask(block, '\n')) & ~inside
+		    & valid;
+
+		while (structurals != 0) {
+			m_structurals.push_back(base + detail::trailing_zeros(structurals));
+			structurals &= structurals - 1;
+		}
+	}
+
+	// Indexes whole blocks of buffered input; the partial block at the end waits for more input
+	// unless no more is coming
+	void scan() noexcept {
+
+		buffer_view data = m_reader.view();
+
+		while (data.size() - m_scanned >= detail::scan_block_size) {
+			scan_block(data.data() + m_scanned, m_scanned, ~std::uint64_t{0});
+			m_scanned += detail::scan_block_size;
+		}
+
+		if (m_final && m_scanned < data.size()) {
+
+			char block[detail::scan_block_size] = {};
+			std::size_t size = data.size() - m_scanned;
+
+			std::memcpy(block, data.data() + m_scanned, size);
+			scan_block(block, m_scanned, (std::uint64_t{1} << size) - 1);
+			m_scanned = data.size();
+		}
+	}
+
+	// Drops finished rows and reads more input, then indexes the partial row again from its start
+	void refill() noexcept {
+
+		m_reader.consume(m_offset);
+
+		m_structurals.clear();
+		m_offset = 0;
+		m_cursor = 0;
+		m_scanned = 0;
+		m_in_quote = false;
+
+		if (m_reader.size() == m_reader.capacity()) {
+			m_reader.reserve(m_reader.capacity() * 2);
+		}
+
+		if (m_reader.fill() == 0) {
+			m_final = true;
+		}
+
+		scan();
+	}
+
+	void add_field(csv_row &row, const char *field, std::size_t size, bool last) noexcept {
+
+		if (last && size != 0 && field[size - 1] == '\r') {
+			--size;
+		}
+
+		if (!m_quoting || size == 0 || field[0] != '"') {
+			row.m_fields.emplace_back(field, size);
+			return;
+		}
+
+		std::size_t close = size - 1;
+
+		while (close != 0 && field[close] != '"') {
+			--close;
+		}
+
+		const char *content = field + 1;
+		std::size_t length = close != 0 ? close - 1 : size - 1;
+
+		if (std::memchr(content, '"', length) == nullptr) {
+			row.m_fields.emplace_back(content, length);
+			return;
+		}
+
+		const char *output = m_scratch.data() + m_scratch.size();
+
+		for (std::size_t i = 0; i < length; ++i) {
+
+			m_scratch.push_back(content[i]);
+
+			if (content[i] == '"' && i + 1 < length && content[i + 1] == '"') {
+				++i;
+			}
+		}
+
+		row.m_fields.emplace_back(output, static_cast<std::size_t>(m_scratch.data()
+		                                                           + m_scratch.size() - output));
+	}
+
+	void build_row(csv_row &row, std::size_t last, std::size_t row_end) noexcept {
+
+		const char *data = m_reader.view().data();
+		std::size_t start = m_offset;
+
+		// Unescaped fields never grow, so reserving the row length keeps scratch views stable
+		m_scratch.reserve(row_end - m_offset);
+
+		for (; m_cursor < last; ++m_cursor) {
+
+			std::size_t position = m_structurals[m_cursor];
+
+			add_field(row, data + start, position - start, false);
+			start = position + 1;
+		}
+
+		add_field(row, data + start, row_end - start, true);
+	}
+
+public:
+	explicit csv_reader(cfile &file, char delimiter = ',', bool quoting = true,
+	                    std::size_t capacity = buffered_reader::default_capacity) noexcept :
+	    m_reader{file, capacity}, m_offset{0}, m_cursor{0}, m_scanned{0}, m_in_quote{false},
+	    m_final{false}, m_quoting{quoting}, m_delimiter{delimiter} {}
+
+	// Returns false once every record has been read
+	bool next(csv_row &row) noexcept {
+
+		row.m_fields.clear();
+		m_scratch.clear();
+
+		for (;;) {
+
+			buffer_view data = m_reader.view();
+			std::size_t end = m_cursor;
+
+			while (end < m_structurals.size() && data[m_structurals[end]] != '\n') {
+				++end;
+			}
+
+			if (end < m_structurals.size()) {
+
+				std::size_t row_end = m_structurals[end];
+
+				build_row(row, end, row_end);
+				m_cursor = end + 1;
+				m_offset = row_end + 1;
+
+				return true;
+			}
+
+			if (m_final) {
+
+				if (m_offset == data.size()) {
+					return false;
+				}
+
+				build_row(row, end, data.size());
+				m_offset = data.size();
+
+				return true;
+			}
+
+			refill();
+		}
+	}
+
+	[[nodiscard]] bool error() noexcept {
+		return m_reader.error();
+	}
+};
+
+namespace detail {
+
+constexpr char digit_pairs[] = "00010203040506070809"
+                               "10111213141516171819"
+                               "20212223242526272829"
+                               "30313233343536373839"
+                               "40414243444546474849"
+                               "50515253545556575859"
+                               "60616263646566676869"
+                               "70717273747576777879"
+                               "80818283848586878889"
+                               "90919293949596979899";
+
+// Writes the decimal digits of value ending just before end, two digits per table lookup, and
+// returns a pointer to the first digit
+inline char *format_digits(std::uint64_t value, char *end) noexcept {
+
+	while (value >= 100) {
+
+		std::size_t pair = static_cast<std::size_t>(value % 100) * 2;
+		value /= 100;
+
+		*--end = digit_pairs[pair + 1];
+		*--end = digit_pairs[pair];
+	}
+
+	if (value >= 10) {
+
+		std::size_t pair = static_cast<std::size_t>(value) * 2;
+
+		*--end = digit_pairs[pair + 1];
+		*--end = digit_pairs[pair];
+	}
+	else {
+		*--end = static_cast<char>('0' + value);
+	}
+
+	return end;
+}
+
+} // namespace detail
+
+// Writes CSV or TSV rows into an owned buffer that goes to the cfile with a single fwrite when it
+// fills up. Numbers are formatted without printf, and a text field is quoted only if a vector
+// scan finds a delimiter, quote or line break in it. The cfile is not owned and must outlive the
+// writer.
+class csv_writer {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_size;
+	bool m_row_start;
+	bool m_quoting;
+	char m_delimiter;
+
+	// Digits after the point beyond this are not printed by field(double)
+	static constexpr int max_precision = 40;
+
+	// Largest output of a single number including its null terminator, reached by printf("%.*f")
+	// of the largest negative double: sign, integer digits, point and fraction digits
+	static constexpr std::size_t max_number_size = DBL_MAX_10_EXP + 4 + max_precision;
+
+	static std::size_t buffer_size(std::size_t capacity) noexcept {
+		return capacity > max_number_size ? capacity : std::size_t{max_number_size};
+	}
+
+	void append(const char *data, std::size_t size) noexcept {
+
+		if (size <= m_capacity - m_size) {
+			std::memcpy(m_buffer.get() + m_size, data, size);
+			m_size += size;
+		}
+		else if (flush() && size <= m_capacity) {
+			std::memcpy(m_buffer.get(), data, size);
+			m_size = size;
+		}
+		else {
+			m_file->fwrite(data, 1, size);
+		}
+	}
+
+	void put(char character) noexcept {
+
+		if (m_size == m_capacity && (!flush() || m_capacity == 0)) {
+			m_file->fputc(character);
+			return;
+		}
+
+		m_buffer[m_size++] = character;
+	}
+
+	void separate() noexcept {
+
+		if (!m_row_start) {
+			put(m_delimiter);
+		}
+
+		m_row_start = false;
+	}
+
+	bool append_number(const char *data, std::size_t size) noexcept {
+
+		separate();
+		append(data, size);
+
+		return m_file->ferror() == 0;
+	}
+
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+
+	explicit csv_writer(cfile &file, char delimiter = ',', bool quoting = true,
+	                    std::size_t capacity = default_capacity) noexcept :
+	    m_file{&file}, m_buffer{new (std::nothrow) char[buffer_size(capacity)]},
+	    m_capacity{m_buffer != nullptr ? buffer_size(capacity) : 0}, m_size{0}, m_row_start{true},
+	    m_quoting{quoting}, m_delimiter{delimiter} {}
+
+	csv_writer(const csv_writer &) = delete;
+
+	csv_writer(csv_writer &&other) noexcept :
+	    m_file{other.m_file}, m_buffer{std::move(other.m_buffer)},
+	    m_capacity{std::exchange(other.m_capacity, 0)}, m_size{std::exchange(other.m_size, 0)},
+	    m_row_start{other.m_row_start}, m_quoting{other.m_quoting},
+	    m_delimiter{other.m_delimiter} {}
+
+	csv_writer &operator=(const csv_writer &) = delete;
+
+	csv_writer &operator=(csv_writer &&) = delete;
+
+	~csv_writer() {
+		flush();
+	}
+
+	bool field(buffer_view text) noexcept {
+
+		separate();
+
+		std::size_t special = m_quoting ? detail::find_first_of(text.data(), text.size(),
+		                                                        m_delimiter, '"', '\n', '\r')
+		                                : text.size();
+
+		if (special == text.size()) {
+			append(text.data(), text.size());
+			return m_file->ferror() == 0;
+		}
+
+		put('"');
+		append(text.data(), special);
+
+		for (std::size_t i = special; i < text.size(); ++i) {
+
+			if (text[i] == '"') {
+				put('"');
+			}
+
+			put(text[i]);
+		}
+
+		put('"');
+
+		return m_file->ferror() == 0;
+	}
+
+	bool field(const char *text) noexcept {
+		return field(buffer_view{text});
+	}
+
+	bool field(const std::string &text) noexcept {
+		return field(buffer_view{text.data(), text.size()});
+	}
+
+	// A single character, written as a one-character text field
+	bool field(char value) noexcept {
+		return field(buffer_view{&value, 1});
+	}
+
+	bool field(bool value) noexcept {
+		return field(value ? buffer_view{"true", 4} : buffer_view{"false", 5});
+	}
+
+	template <typename Type,
+	          std::enable_if_t<std::is_integral<Type>::value && !std::is_same<Type, char>::value
+	                               && !std::is_same<Type, bool>::value,
+	                           int> = 0>
+	bool field(Type value) noexcept {
+
+		char digits[24];
+		char *end = digits + sizeof(digits);
+		char *begin;
+
+		if (std::is_signed<Type>::value && value < 0) {
+			begin = detail::format_digits(0 - static_cast<std::uint64_t>(value), end);
+			*--begin = '-';
+		}
+		else {
+			begin = detail::format_digits(static_cast<std::uint64_t>(value), end);
+		}
+
+		return append_number(begin, static_cast<std::size_t>(end - begin));
+	}
+
+	// Formats like printf("%.*f"). Values whose scaled magnitude fits comfortably in an integer
+	// are rounded and printed from integer digits; values close enough to a rounding tie for the
+	// result to depend on the exact binary value, and very large or non-finite values, go
+	// through snprintf. The precision is capped at max_precision digits.
+	bool field(double value, int precision = 6) noexcept {
+
+		static constexpr double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+		if (precision >= 0 && precision <= 9 && std::isfinite(value)) {
+
+			double scaled = std::fabs(value) * powers[precision];
+			double fraction = scaled - std::floor(scaled);
+
+			if (scaled < 17592186044416.0 && std::fabs(fraction - 0.5) > 0.01) {
+
+				std::uint64_t rounded = static_cast<std::uint64_t>(scaled + 0.5);
+				std::uint64_t scale = static_cast<std::uint64_t>(powers[precision]);
+
+				char digits[40];
+				char *end = digits + sizeof(digits);
+				char *begin = end;
+
+				if (precision != 0) {
+
+					char *fraction_end = end;
+					begin = detail::format_digits(rounded % scale, end);
+
+					while (fraction_end - begin < precision) {
+						*--begin = '0';
+					}
+
+					*--begin = '.';
+				}
+
+				begin = detail::format_digits(rounded / scale, begin);
+
+				if (std::signbit(value)) {
+					*--begin = '-';
+				}
+
+				return append_number(begin, static_cast<std::size_t>(end - begin));
+			}
+		}
+
+		if (precision > max_precision) {
+			precision = max_precision;
+		}
+
+		char text[max_number_size];
+		int length = std::snprintf(text, sizeof(text), "%.*f", precision, value);
+
+		if (length < 0) {
+			return false;
+		}
+
+		std::size_t size = static_cast<std::size_t>(length);
+
+		return append_number(text, size < sizeof(text) ? size : sizeof(text) - 1);
+	}
+
+	bool end_row() noexcept {
+
+		put('\n');
+		m_row_start = true;
+
+		return m_file->ferror() == 0;
+	}
+
+	template <typename... Fields>
+	bool row(const Fields &...fields) noexcept {
+
+		bool results[] = {field(fields)..., end_row()};
+		bool result = true;
+
+		for (bool value : results) {
+			result = result && value;
+		}
+
+		return result;
+	}
+
+	// Hands buffered rows to the cfile; this does not call cfile::fflush
+	bool flush() noexcept {
+
+		if (m_size == 0) {
+			return true;
+		}
+
+		std::size_t size = std::exchange(m_size, 0);
+
+		return m_file->fwrite(m_buffer.get(), 1, size) == size;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // CSV_HPP
@@ -0,0 +1,265 @@
+#pragma once
+#ifndef EXTERNAL_SORT_HPP
+#define EXTERNAL_SORT_HPP
+
+
+#include "buffer_view.hpp"
+#include "cfile.hpp"
+#include "merge.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+struct external_sort_options {
+	// Size of each fixed-size record, or zero to sort lines
+	std::size_t record_size = 0;
+	// Threads sorting runs; zero uses one per hardware thread
+	std::size_t threads = 0;
+	// Read-ahead buffer of each run during the merge, capped by the memory budget
+	std::size_t read_ahead = 1024 * 1024;
+};
+
+namespace detail {
+
+// Sorts the records of one chunk and writes them to output. Returns false if the index cannot be
+// allocated, as this also runs on worker threads where an exception would end the program.
+template <typename Less>
+bool sort_chunk(const char *data, std::size_t size, std::size_t record_size, Less less,
+                cfile &output) {
+
+	std::vector<buffer_view> records;
+
+	try {
+
+		if (record_size != 0) {
+
+			records.reserve(size / record_size);
+
+			for (std::size_t offset = 0; offset + record_size <= size; offset += record_size) {
+				records.emplace_back(data + offset, record_size);
+			}
+		}
+		else {
+
+			for (std::size_t offset = 0; offset < size;) {
+
+				const void *newline = std::memchr(data + offset, '\n', size - offset);
+				std::size_t end =
+				    newline != nullptr ? static_cast<const char *>(newline) - data : size;
+
+				records.emplace_back(data + offset, end - offset);
+				offset = end + 1;
+			}
+		}
+	}
+	catch (const std::bad_alloc &) {
+		return false;
+	}
+
+	std::sort(records.begin(), records.end(), less);
+
+	record_output writer{output, record_size == 0, 1024 * 1024};
+
+	for (buffer_view record : records) {
+		writer.write(record);
+	}
+
+	return writer.flush();
+}
+
+} // namespace detail
+
+// Sorts the lines or fixed-size records of in into out when they may not fit in memory. The input
+// is cut into chunks of about memory_budget / (threads + 1) bytes; worker threads sort chunks
+// while the next one is read and spill each as a sorted run to a temporary file. The runs are then
+// merged with a loser tree, each read through its own large read-ahead buffer. Input that fits in
+// one chunk is sorted in memory without temporary files. less compares two records given as
+// buffer_views; lines exclude their '\n', and every output line ends with one.
+//
+// The budget covers the record bytes; sorting also needs an index of 16 bytes per record. Returns
+// false on a read, write or allocation failure, if a sorting thread cannot be started, or if
+// fixed-size input ends partway through a record.
+template <typename Less = std::less<buffer_view>>
+bool external_sort(cfile &in, cfile &out, Less less = Less{},
+                   std::size_t memory_budget = 256 * 1024 * 1024,
+                   external_sort_options options = external_sort_options{}) {
+
+	std::size_t threads = options.threads != 0 ? options.threads
+	                                           : std::max(1u, std::thread::hardware_concurrency());
+	std::size_t record_size = options.record_size;
+	std::size_t chunk_size = std::max<std::size_t>(memory_budget / (threads + 1), 64 * 1024);
+
+	if (record_size != 0) {
+		chunk_size = std::max(chunk_size / record_size, std::size_t{1}) * record_size;
+	}
+
+	std::deque<cfile> runs;
+	std::deque<std::thread> workers;
+	std::atomic<bool> failed{false};
+	std::unique_ptr<char[]> carry;
+	std::size_t carry_size = 0;
+	bool finished = false;
+
+	while (!finished && !failed) {
+
+		std::size_t capacity = std::max(chunk_size, 2 * carry_size);
+		std::shared_ptr<char> data;
+
+		// The control block may still fail to allocate; reset then frees the buffer
+		try {
+			data.reset(new (std::nothrow) char[capacity], std::default_delete<char[]>{});
+		}
+		catch (const std::bad_alloc &) {
+		}
+
+		if (data == nullptr) {
+			failed = true;
+			break;
+		}
+
+		std::size_t size = carry_size;
+
+		if (carry_size != 0) {
+			std::memcpy(data.get(), carry.get(), carry_size);
+		}
+
+		size += in.fread(data.get() + size, 1, capacity - size);
+		finished = size < capacity;
+
+		if (in.ferror() != 0 || (finished && record_size != 0 && size % record_size != 0)) {
+			failed = true;
+			break;
+		}
+
+		// Keep a trailing partial record for the next chunk
+		std::size_t used = size;
+
+		if (!finished) {
+
+			if (record_size != 0) {
+				used = size / record_size * record_size;
+			}
+			else {
+
+				char *end = data.get() + size;
+
+				while (end != data.get() && end[-1] != '\n') {
+					--end;
+				}
+
+				used = static_cast<std::size_t>(end - data.get());
+			}
+		}
+
+		carry_size = size - used;
+		carry.reset(carry_size != 0 ? new (std::nothrow) char[carry_size] : nullptr);
+
+		if (carry_size != 0) {
+
+			if (carry == nullptr) {
+				failed = true;
+				break;
+			}
+
+			std::memcpy(carry.get(), data.get() + used, carry_size);
+		}
+
+		// A line longer than the chunk is carried whole into a larger buffer
+		if (used == 0) {
+			continue;
+		}
+
+		if (finished && runs.empty()) {
+
+			// Everything fit in one chunk
+			return detail::sort_chunk(data.get(), used, record_size, less, out);
+		}
+
+		if (workers.size() == threads) {
+			workers.front().join();
+			workers.pop_front();
+		}
+
+		try {
+
+			runs.push_back(cfile::tmpfile());
+
+			cfile &run = runs.back();
+
+			if (run == nullptr) {
+				failed = true;
+				break;
+			}
+
+			workers.emplace_back([data, used, record_size, less, &run, &failed] {
+
+				if (!detail::sort_chunk(data.get(), used, record_size, less, run)
+				    || run.fflush() != 0) {
+					failed = true;
+				}
+
+				run.rewind();
+			});
+		}
+		catch (const std::bad_alloc &) {
+			failed = true;
+		}
+		catch (const std::system_error &) {
+			failed = true;
+		}
+	}
+
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+
+	if (failed) {
+		return false;
+	}
+
+	if (runs.empty()) {
+		return true;
+	}
+
+	std::size_t read_ahead =
+	    std::max<std::size_t>(std::min(options.read_ahead, memory_budget / runs.size()), 4096);
+
+	try {
+
+		std::vector<detail::record_cursor> cursors;
+
+		cursors.reserve(runs.size());
+
+		for (cfile &run : runs) {
+			cursors.emplace_back(run, record_size, read_ahead);
+		}
+
+		detail::record_output output{out, record_size == 0,
+		                             std::max(read_ahead, std::size_t{65536})};
+
+		return detail::merge_records(cursors, output, less);
+	}
+	catch (const std::bad_alloc &) {
+		return false;
+	}
+}
+
+} // namespace xtr
+
+
+#endif // EXTERNAL_SORT_HPP
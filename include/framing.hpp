@@ -0,0 +1,232 @@
+#pragma once
+#ifndef FRAMING_HPP
+#define FRAMING_HPP
+
+
+#include "buffer_view.hpp"
+#include "buffered_reader.hpp"
+#include "cfile.hpp"
+#include "varint.hpp"
+
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Length prefix placed in front of every frame: a LEB128 varint or a little-endian 32-bit integer
+enum class frame_prefix
+{
+	varint,
+	fixed32
+};
+
+namespace detail {
+
+inline std::size_t encode_frame_prefix(frame_prefix prefix, std::size_t size,
+                                       char *output) noexcept {
+
+	if (prefix == frame_prefix::varint) {
+		return varint::encode(size, output);
+	}
+
+	for (std::size_t i = 0; i < 4; ++i) {
+		output[i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+	}
+
+	return 4;
+}
+
+} // namespace detail
+
+// Coalesces length-prefixed frames in an owned buffer and hands them to the cfile with a single
+// fwrite whenever the buffer fills up. Frames larger than the buffer bypass it. The cfile is not
+// owned and must outlive the writer.
+class frame_writer {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_size;
+	frame_prefix m_prefix;
+
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+
+	explicit frame_writer(cfile &file, frame_prefix prefix = frame_prefix::varint,
+	                      std::size_t capacity = default_capacity) noexcept :
+	    m_file{&file}, m_buffer{new (std::nothrow) char[capacity]},
+	    m_capacity{m_buffer != nullptr ? capacity : 0}, m_size{0}, m_prefix{prefix} {}
+
+	frame_writer(const frame_writer &) = delete;
+
+	frame_writer(frame_writer &&other) noexcept :
+	    m_file{other.m_file}, m_buffer{std::move(other.m_buffer)},
+	    m_capacity{std::exchange(other.m_capacity, 0)}, m_size{std::exchange(other.m_size, 0)},
+	    m_prefix{other.m_prefix} {}
+
+	frame_writer &operator=(const frame_writer &) = delete;
+
+	frame_writer &operator=(frame_writer &&other) noexcept {
+
+		flush();
+
+		m_file = other.m_file;
+		m_buffer = std::move(other.m_buffer);
+		m_capacity = std::exchange(other.m_capacity, 0);
+		m_size = std::exchange(other.m_size, 0);
+		m_prefix = other.m_prefix;
+
+		return *this;
+	}
+
+	~frame_writer() {
+		flush();
+	}
+
+	// Number of bytes waiting in the buffer
+	[[nodiscard]] std::size_t size() const noexcept {
+		return m_size;
+	}
+
+	// Returns false on a write error, or without writing anything for a frame too large for a
+	// fixed32 prefix
+	bool write(const void *data, std::size_t size) noexcept {
+
+		if (m_prefix == frame_prefix::fixed32 && std::uint64_t{size} > UINT32_MAX) {
+			return false;
+		}
+
+		char prefix[varint::max_size64];
+		std::size_t prefix_size = detail::encode_frame_prefix(m_prefix, size, prefix);
+
+		if (prefix_size + size > m_capacity - m_size && !flush()) {
+			return false;
+		}
+
+		if (prefix_size + size > m_capacity) {
+			return m_file->fwrite(prefix, 1, prefix_size) == prefix_size
+			       && m_file->fwrite(data, 1, size) == size;
+		}
+
+		std::memcpy(m_buffer.get() + m_size, prefix, prefix_size);
+
+		if (size != 0) {
+			std::memcpy(m_buffer.get() + m_size + prefix_size, data, size);
+		}
+
+		m_size += prefix_size + size;
+
+		return true;
+	}
+
+	bool write(buffer_view frame) noexcept {
+		return write(frame.data(), frame.size());
+	}
+
+	// Hands buffered frames to the cfile; this does not call cfile::fflush
+	bool flush() noexcept {
+
+		if (m_size == 0) {
+			return true;
+		}
+
+		std::size_t size = std::exchange(m_size, 0);
+
+		return m_file->fwrite(m_buffer.get(), 1, size) == size;
+	}
+};
+
+// Reads length-prefixed frames and returns views into its internal buffer, so a single refill
+// serves every small frame that fits in it. A view stays valid until the next call to next().
+// The cfile is not owned and must outlive the reader.
+class frame_reader {
+private:
+	buffered_reader m_reader;
+	std::size_t m_pending;
+	std::size_t m_max_frame_size;
+	frame_prefix m_prefix;
+	bool m_error;
+
+public:
+	static constexpr std::size_t default_max_frame_size = 64 * 1024 * 1024;
+
+	explicit frame_reader(cfile &file, frame_prefix prefix = frame_prefix::varint,
+	                      std::size_t capacity = buffered_reader::default_capacity,
+	                      std::size_t max_frame_size = default_max_frame_size) noexcept :
+	    m_reader{file, capacity}, m_pending{0}, m_max_frame_size{max_frame_size},
+	    m_prefix{prefix}, m_error{false} {}
+
+	// Returns false at end of input; error() tells a clean end apart from a truncated or
+	// oversized frame
+	bool next(buffer_view &frame) noexcept {
+
+		m_reader.consume(std::exchange(m_pending, 0));
+
+		if (m_error) {
+			return false;
+		}
+
+		std::size_t prefix_size = m_prefix == frame_prefix::varint ? 1 : 4;
+		buffer_view header = m_reader.peek(prefix_size);
+
+		if (header.empty()) {
+			m_error = m_reader.error();
+			return false;
+		}
+
+		std::uint64_t size = 0;
+
+		if (m_prefix == frame_prefix::varint) {
+
+			if ((header[0] & 0x80) != 0) {
+				header = m_reader.peek(varint::max_size64);
+			}
+
+			prefix_size = varint::decode(header.data(), header.size(), size);
+		}
+		else if (header.size() >= 4) {
+
+			for (std::size_t i = 0; i < 4; ++i) {
+				std::uint64_t byte = static_cast<unsigned char>(header[i]);
+				size |= byte << (8 * i);
+			}
+		}
+		else {
+			prefix_size = 0;
+		}
+
+		if (prefix_size == 0 || size > m_max_frame_size) {
+			m_error = true;
+			return false;
+		}
+
+		std::size_t total = prefix_size + static_cast<std::size_t>(size);
+		buffer_view data = m_reader.peek(total);
+
+		if (data.size() < total) {
+			m_error = true;
+			return false;
+		}
+
+		frame = data.substr(prefix_size, static_cast<std::size_t>(size));
+		m_pending = total;
+
+		return true;
+	}
+
+	[[nodiscard]] bool error() const noexcept {
+		return m_error;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // FRAMING_HPP
@@ -0,0 +1,69 @@
+#pragma once
+#ifndef HASH_HPP
+#define HASH_HPP
+
+
+#include "cfile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+namespace detail {
+
+[[nodiscard]] inline std::uint64_t load_le64(const unsigned char *data) noexcept {
+
+	std::uint64_t result;
+	std::memcpy(&result, data, sizeof(result));
+
+	return native_little_endian ? result : byteswap(result);
+}
+
+[[nodiscard]] inline std::uint64_t hash_mix(std::uint64_t value) noexcept {
+
+	value ^= value >> 33;
+	value *= 0xFF51AFD7ED558CCDull;
+	value ^= value >> 33;
+	value *= 0xC4CEB9FE1A85EC53ull;
+	value ^= value >> 33;
+
+	return value;
+}
+
+} // namespace detail
+
+// Fast non-cryptographic 64-bit hash that consumes eight bytes per step. Results are the same on
+// every platform, so they may be stored in files.
+[[nodiscard]] inline std::uint64_t hash_bytes(const void *data, std::size_t size,
+                                              std::uint64_t seed = 0) noexcept {
+
+	constexpr std::uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+
+	const unsigned char *input = static_cast<const unsigned char *>(data);
+	std::uint64_t result = seed ^ (size * multiplier);
+
+	for (; size >= 8; size -= 8, input += 8) {
+		std::uint64_t word = detail::hash_mix(detail::load_le64(input) * multiplier);
+		result = ((result << 27) | (result >> 37)) ^ word;
+		result = result * 5 + 0x52DCE729;
+	}
+
+	if (size != 0) {
+
+		unsigned char tail[8] = {};
+		std::memcpy(tail, input, size);
+
+		result ^= detail::hash_mix(detail::load_le64(tail) * multiplier);
+	}
+
+	return detail::hash_mix(result);
+}
+
+} // namespace xtr
+
+
+#endif // HASH_HPP
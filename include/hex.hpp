@@ -0,0 +1,331 @@
+#pragma once
+#ifndef HEX_HPP
+#define HEX_HPP
+
+
+#include "cfile.hpp"
+
+#include <memory>
+#include <new>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+
+// 'extra' namespace
+namespace xtr {
+
+namespace detail {
+
+constexpr unsigned char hex_invalid = 0xFF;
+constexpr unsigned char hex_space = 0xFE;
+
+struct hex_tables {
+	char lower[256][2];
+	char upper[256][2];
+	unsigned char values[256];
+};
+
+inline hex_tables make_hex_tables() noexcept {
+
+	constexpr char lower_digits[] = "0123456789abcdef";
+	constexpr char upper_digits[] = "0123456789ABCDEF";
+
+	hex_tables result{};
+
+	for (unsigned i = 0; i < 256; ++i) {
+		result.lower[i][0] = lower_digits[i >> 4];
+		result.lower[i][1] = lower_digits[i & 0xF];
+		result.upper[i][0] = upper_digits[i >> 4];
+		result.upper[i][1] = upper_digits[i & 0xF];
+	}
+
+	std::memset(result.values, hex_invalid, sizeof(result.values));
+
+	for (unsigned i = 0; i < 16; ++i) {
+		result.values[static_cast<unsigned char>(lower_digits[i])] = static_cast<unsigned char>(i);
+		result.values[static_cast<unsigned char>(upper_digits[i])] = static_cast<unsigned char>(i);
+	}
+
+	result.values[static_cast<unsigned char>(' ')] = hex_space;
+	result.values[static_cast<unsigned char>('\t')] = hex_space;
+	result.values[static_cast<unsigned char>('\r')] = hex_space;
+	result.values[static_cast<unsigned char>('\n')] = hex_space;
+
+	return result;
+}
+
+inline const hex_tables &get_hex_tables() noexcept {
+
+	static const hex_tables tables = make_hex_tables();
+
+	return tables;
+}
+
+#if defined(__SSSE3__)
+// Encodes 16 bytes into 32 digits: the nibbles are split apart, mapped to digits with a shuffle
+// of the digit string and interleaved high nibble first
+inline void hex_encode16(const unsigned char *input, char *output, bool uppercase) noexcept {
+
+	__m128i digits = uppercase ? _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+	                                           'A', 'B', 'C', 'D', 'E', 'F')
+	                           : _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
+	                                           'a', 'b', 'c', 'd', 'e', 'f');
+	__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+	__m128i mask = _mm_set1_epi8(0x0F);
+	__m128i high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+	__m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, mask));
+
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(output), _mm_unpacklo_epi8(high, low));
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(output + 16), _mm_unpackhi_epi8(high, low));
+}
+
+// Decodes 16 digits of either case into 8 bytes. Returns false, writing nothing, if any character
+// is not a digit.
+[[nodiscard]] inline bool hex_decode16(const unsigned char *input,
+                                       unsigned char *output) noexcept {
+
+	__m128i characters = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+
+	// Wrapping subtraction leaves 0-9 only for '0'-'9', and 0-5 only for 'a'-'f' or 'A'-'F'
+	__m128i decimals = _mm_sub_epi8(characters, _mm_set1_epi8('0'));
+	__m128i letters =
+	    _mm_sub_epi8(_mm_or_si128(characters, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_decimal = _mm_and_si128(_mm_cmpgt_epi8(decimals, _mm_set1_epi8(-1)),
+	                                   _mm_cmplt_epi8(decimals, _mm_set1_epi8(10)));
+	__m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(letters, _mm_set1_epi8(-1)),
+	                                  _mm_cmplt_epi8(letters, _mm_set1_epi8(6)));
+
+	if (_mm_movemask_epi8(_mm_or_si128(is_decimal, is_letter)) != 0xFFFF) {
+		return false;
+	}
+
+	__m128i nibbles =
+	    _mm_or_si128(_mm_and_si128(is_decimal, decimals),
+	                 _mm_and_si128(is_letter, _mm_add_epi8(letters, _mm_set1_epi8(10))));
+
+	// Each pair becomes high * 16 + low in a 16-bit lane, then the lanes are packed to bytes
+	__m128i pairs = _mm_maddubs_epi16(nibbles, _mm_set1_epi16(0x0110));
+
+	_mm_storel_epi64(reinterpret_cast<__m128i *>(output), _mm_packus_epi16(pairs, pairs));
+
+	return true;
+}
+#endif
+
+} // namespace detail
+
+// Encodes everything written to it as hexadecimal digit pairs, 16 bytes at a time with SSSE3 or
+// one table lookup per byte otherwise, into an owned buffer that goes to the cfile with a single
+// fwrite when it fills up. The cfile is not owned and must outlive the writer.
+class hex_writer {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_size;
+	bool m_uppercase;
+
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+
+	explicit hex_writer(cfile &file, bool uppercase = false,
+	                    std::size_t capacity = default_capacity) noexcept :
+	    m_file{&file}, m_buffer{new (std::nothrow) char[capacity < 2 ? 2 : capacity]},
+	    m_capacity{m_buffer != nullptr ? (capacity < 2 ? 2 : capacity) : 0}, m_size{0},
+	    m_uppercase{uppercase} {}
+
+	hex_writer(const hex_writer &) = delete;
+
+	hex_writer(hex_writer &&other) noexcept :
+	    m_file{other.m_file}, m_buffer{std::move(other.m_buffer)},
+	    m_capacity{std::exchange(other.m_capacity, 0)}, m_size{std::exchange(other.m_size, 0)},
+	    m_uppercase{other.m_uppercase} {}
+
+	hex_writer &operator=(const hex_writer &) = delete;
+
+	hex_writer &operator=(hex_writer &&other) noexcept {
+
+		flush();
+
+		m_file = other.m_file;
+		m_buffer = std::move(other.m_buffer);
+		m_capacity = std::exchange(other.m_capacity, 0);
+		m_size = std::exchange(other.m_size, 0);
+		m_uppercase = other.m_uppercase;
+
+		return *this;
+	}
+
+	~hex_writer() {
+		flush();
+	}
+
+	bool write(const void *data, std::size_t size) noexcept {
+
+		if (m_capacity == 0) {
+			return false;
+		}
+
+		const detail::hex_tables &tables = detail::get_hex_tables();
+		const char(*pairs)[2] = m_uppercase ? tables.upper : tables.lower;
+		const unsigned char *input = static_cast<const unsigned char *>(data);
+
+		while (size != 0) {
+
+			std::size_t count = (m_capacity - m_size) / 2;
+
+			if (count == 0) {
+
+				if (!flush()) {
+					return false;
+				}
+
+				continue;
+			}
+
+			if (count > size) {
+				count = size;
+			}
+
+			char *output = m_buffer.get() + m_size;
+			std::size_t i = 0;
+
+#if defined(__SSSE3__)
+			for (; i + 16 <= count; i += 16) {
+				detail::hex_encode16(input + i, output + 2 * i, m_uppercase);
+			}
+#endif
+
+			for (; i < count; ++i) {
+				std::memcpy(output + 2 * i, pairs[input[i]], 2);
+			}
+
+			m_size += 2 * count;
+			input += count;
+			size -= count;
+		}
+
+		return true;
+	}
+
+	// Hands buffered digits to the cfile; this does not call cfile::fflush
+	bool flush() noexcept {
+
+		if (m_size == 0) {
+			return true;
+		}
+
+		std::size_t size = std::exchange(m_size, 0);
+
+		return m_file->fwrite(m_buffer.get(), 1, size) == size;
+	}
+};
+
+// Decodes hexadecimal digit pairs in either case from a cfile, skipping whitespace between
+// digits. Runs of 16 digits are decoded at once with SSSE3. The cfile is not owned and must
+// outlive the reader.
+class hex_reader {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_begin;
+	std::size_t m_end;
+	unsigned m_high;
+	bool m_has_high;
+	bool m_error;
+
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+
+	explicit hex_reader(cfile &file, std::size_t capacity = default_capacity) noexcept :
+	    m_file{&file}, m_buffer{new (std::nothrow) char[capacity]},
+	    m_capacity{m_buffer != nullptr ? capacity : 0}, m_begin{0}, m_end{0}, m_high{0},
+	    m_has_high{false}, m_error{m_buffer == nullptr} {}
+
+	// Returns the number of decoded bytes stored, which is less than size only at the end of the
+	// data or on an error
+	std::size_t read(void *buffer, std::size_t size) noexcept {
+
+		const detail::hex_tables &tables = detail::get_hex_tables();
+
+		unsigned char *output = static_cast<unsigned char *>(buffer);
+		std::size_t result = 0;
+
+		while (result < size && !m_error) {
+
+			if (m_begin == m_end) {
+
+				m_begin = 0;
+				m_end = m_file->fread(m_buffer.get(), 1, m_capacity);
+
+				if (m_end == 0) {
+					m_error = m_has_high;
+					break;
+				}
+			}
+
+			const unsigned char *input = reinterpret_cast<const unsigned char *>(m_buffer.get());
+
+#if defined(__SSSE3__)
+			while (!m_has_high && m_end - m_begin >= 16 && size - result >= 8
+			       && detail::hex_decode16(input + m_begin, output + result)) {
+				result += 8;
+				m_begin += 16;
+			}
+#endif
+
+			while (!m_has_high && m_end - m_begin >= 2 && result < size) {
+
+				unsigned high = tables.values[input[m_begin]];
+				unsigned low = tables.values[input[m_begin + 1]];
+
+				if ((high | low) >= 16) {
+					break;
+				}
+
+				output[result++] = static_cast<unsigned char>((high << 4) | low);
+				m_begin += 2;
+			}
+
+			if (m_begin == m_end || result == size) {
+				continue;
+			}
+
+			unsigned value = tables.values[input[m_begin++]];
+
+			if (value < 16) {
+
+				if (m_has_high) {
+					output[result++] = static_cast<unsigned char>((m_high << 4) | value);
+				}
+				else {
+					m_high = value;
+				}
+
+				m_has_high = !m_has_high;
+			}
+			else if (value != detail::hex_space) {
+				m_error = true;
+			}
+		}
+
+		return result;
+	}
+
+	[[nodiscard]] bool error() noexcept {
+		return m_error || m_file->ferror() != 0;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // HEX_HPP
@@ -0,0 +1,644 @@
+#pragma once
+#ifndef KVLOG_HPP
+#define KVLOG_HPP
+
+
+#include "buffer_view.hpp"
+#include "buffered_reader.hpp"
+#include "cfile.hpp"
+#include "crc32.hpp"
+#include "platform.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+struct kvlog_options {
+	std::size_t max_segment_size = 64 * 1024 * 1024;
+	bool sync_writes = false;
+};
+
+// Append-only key-value store in the style of Bitcask. Every put or remove appends one record to
+// the active data segment with a single fwrite, and an in-memory hash index maps each live key to
+// the segment, offset and size of its value, so a lookup is one positional read.
+//
+// Segments are files named <base>.<id>.data. A record is a CRC-32 over the rest of the record,
+// the key size and value size as little-endian 32-bit integers (a value size of 0xFFFFFFFF marks a
+// removal), then the key and value bytes. On open the index is rebuilt from the segments in id
+// order, stopping at the first damaged record of a segment, or from a <base>.<id>.hint file where
+// compaction left one. compact() may run on a background thread while other threads keep using
+// the store; it rewrites the live records of all sealed segments into one new segment.
+class kvlog {
+public:
+	using options = kvlog_options;
+
+private:
+	struct location {
+		std::uint32_t segment;
+		std::uint32_t size;
+		std::uint64_t offset;
+	};
+
+	static constexpr std::uint32_t tombstone = 0xFFFFFFFF;
+	static constexpr std::size_t header_size = 12;
+
+	std::string m_base;
+	options m_options;
+	std::unordered_map<std::string, location> m_index;
+	std::map<std::uint32_t, std::shared_ptr<cfile>> m_segments;
+	cfile m_writer;
+	std::uint64_t m_active_size;
+	std::uint32_t m_active;
+	std::uint32_t m_first;
+	bool m_dirty;
+	mutable std::mutex m_mutex;
+	std::mutex m_compaction_mutex;
+
+	[[nodiscard]] std::string filename(std::uint32_t id, const char *extension) const {
+
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), ".%08lu.%s", static_cast<unsigned long>(id),
+		              extension);
+
+		return m_base + suffix;
+	}
+
+	[[nodiscard]] static std::uint32_t load_u32(const char *data) noexcept {
+
+		std::uint32_t result = 0;
+
+		for (std::size_t i = 0; i < 4; ++i) {
+			result |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+		}
+
+		return result;
+	}
+
+	static void store_u32(char *data, std::uint32_t value) noexcept {
+
+		for (std::size_t i = 0; i < 4; ++i) {
+			data[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	// Record bytes for one put or remove, ready for a single fwrite
+	[[nodiscard]] static std::string make_record(buffer_view key, const char *value,
+	                                             std::uint32_t value_size) {
+
+		std::size_t payload = value_size == tombstone ? 0 : value_size;
+		std::string result(header_size + key.size() + payload, '\0');
+		char *data = &result[0];
+
+		store_u32(data + 4, static_cast<std::uint32_t>(key.size()));
+		store_u32(data + 8, value_size);
+		std::memcpy(data + header_size, key.data(), key.size());
+
+		if (payload != 0) {
+			std::memcpy(data + header_size + key.size(), value, payload);
+		}
+
+		store_u32(data, crc32(data + 4, result.size() - 4));
+
+		return result;
+	}
+
+	void load_hint(std::uint32_t id, cfile &hint) {
+
+		buffered_reader reader{hint};
+		std::uint64_t remaining = platform::file_size(hint);
+
+		for (;;) {
+
+			buffer_view header = reader.peek(16);
+
+			if (header.size() < 16) {
+				break;
+			}
+
+			std::uint32_t key_size = load_u32(header.data());
+
+			if (16 + std::uint64_t{key_size} > remaining) {
+				break;
+			}
+
+			location value{id, load_u32(header.data() + 4),
+			               load_u32(header.data() + 8)
+			                   | static_cast<std::uint64_t>(load_u32(header.data() + 12)) << 32};
+
+			buffer_view entry = reader.peek(16 + std::size_t{key_size});
+
+			if (entry.size() < 16 + std::size_t{key_size}) {
+				break;
+			}
+
+			m_index[std::string{entry.data() + 16, key_size}] = value;
+			reader.consume(16 + std::size_t{key_size});
+			remaining -= 16 + std::uint64_t{key_size};
+		}
+	}
+
+	void load_segment(std::uint32_t id, cfile &segment) {
+
+		cfile hint{filename(id, "hint").c_str(), mode::read | mode::binary};
+
+		if (hint != nullptr) {
+			load_hint(id, hint);
+			return;
+		}
+
+		buffered_reader reader{segment};
+		std::uint64_t length = platform::file_size(segment);
+		std::uint64_t offset = 0;
+
+		for (;;) {
+
+			buffer_view header = reader.peek(header_size);
+
+			if (header.size() < header_size) {
+				break;
+			}
+
+			std::uint32_t key_size = load_u32(header.data() + 4);
+			std::uint32_t value_size = load_u32(header.data() + 8);
+			std::uint64_t record_size = header_size + std::uint64_t{key_size}
+			                            + (value_size == tombstone ? 0 : value_size);
+
+			// The sizes are not covered by a checked CRC yet; a torn tail claiming more than the
+			// segment holds must not make the reader buffer it
+			if (record_size > length - offset) {
+				break;
+			}
+
+			std::size_t size = static_cast<std::size_t>(record_size);
+			buffer_view record = reader.peek(size);
+
+			if (record.size() < size
+			    || crc32(record.data() + 4, size - 4) != load_u32(record.data())) {
+				break;
+			}
+
+			std::string key{record.data() + header_size, key_size};
+
+			if (value_size == tombstone) {
+				m_index.erase(key);
+			}
+			else {
+				m_index[std::move(key)] = location{id, value_size, offset + header_size + key_size};
+			}
+
+			reader.consume(size);
+			offset += size;
+		}
+	}
+
+	bool open_active(std::uint32_t id) {
+
+		std::string name = filename(id, "data");
+
+		m_writer.reset();
+		m_writer.fopen(name.c_str(), mode::append | mode::binary);
+
+		std::shared_ptr<cfile> reader = std::make_shared<cfile>(name.c_str(), "rb");
+
+		if (m_writer == nullptr || *reader == nullptr) {
+			return false;
+		}
+
+		m_segments[id] = std::move(reader);
+		m_active = id;
+		m_active_size = 0;
+		m_dirty = false;
+
+		return true;
+	}
+
+	bool write_first(std::uint32_t first) {
+
+		std::string name = m_base + ".meta";
+		std::string temporary = name + ".tmp";
+
+		{
+			cfile meta{temporary.c_str(), mode::write | mode::binary};
+
+			if (meta == nullptr || meta.write_le(first) != 1 || !platform::sync(meta)) {
+				return false;
+			}
+		}
+
+		if (cfile::rename(temporary.c_str(), name.c_str()) != 0) {
+			cfile::remove(name.c_str());
+			return cfile::rename(temporary.c_str(), name.c_str()) == 0;
+		}
+
+		return true;
+	}
+
+	// Appends one record to the active segment, moving to a new segment first if it is full, and
+	// returns the location of the value
+	bool append(buffer_view key, const char *value, std::uint32_t value_size,
+	            location &result) {
+
+		std::string record = make_record(key, value, value_size);
+
+		if (m_active_size != 0 && m_active_size + record.size() > m_options.max_segment_size
+		    && !open_active(m_active + 1)) {
+			return false;
+		}
+
+		if (m_writer.fwrite(record.data(), 1, record.size()) != record.size()) {
+			return false;
+		}
+
+		if (m_options.sync_writes && !platform::sync(m_writer)) {
+			return false;
+		}
+
+		result = location{m_active, value_size, m_active_size + header_size + key.size()};
+		m_active_size += record.size();
+		m_dirty = !m_options.sync_writes;
+
+		return true;
+	}
+
+	bool open_store(const char *base, options settings) {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		m_base = base;
+		m_options = settings;
+		m_index.clear();
+		m_segments.clear();
+		m_first = 0;
+
+		cfile meta{(m_base + ".meta").c_str(), mode::read | mode::binary};
+
+		if (meta != nullptr && meta.read_le(m_first) != 1) {
+			return false;
+		}
+
+		cfile::remove((m_base + ".compact.tmp").c_str());
+		cfile::remove((m_base + ".hint.tmp").c_str());
+
+		// Inputs of a compaction interrupted after the meta file was updated
+		for (std::uint32_t id = m_first; id != 0; --id) {
+
+			std::string name = filename(id - 1, "data");
+
+			if (!platform::exists(name.c_str())) {
+				break;
+			}
+
+			cfile::remove(name.c_str());
+			cfile::remove(filename(id - 1, "hint").c_str());
+		}
+
+		std::uint32_t next = m_first;
+
+		// A single missing id is the output of a compaction that never finished
+		for (std::uint32_t id = m_first;; ++id) {
+
+			std::shared_ptr<cfile> segment =
+			    std::make_shared<cfile>(filename(id, "data").c_str(), "rb");
+
+			if (*segment == nullptr) {
+
+				if (!platform::exists(filename(id + 1, "data").c_str())) {
+					break;
+				}
+
+				continue;
+			}
+
+			load_segment(id, *segment);
+			m_segments[id] = std::move(segment);
+			next = id + 1;
+		}
+
+		return open_active(next);
+	}
+
+	bool compact_segments() {
+
+		std::lock_guard<std::mutex> compaction{m_compaction_mutex};
+
+		std::vector<std::pair<std::string, location>> live;
+		std::map<std::uint32_t, std::shared_ptr<cfile>> inputs;
+		std::uint32_t output;
+
+		{
+			std::lock_guard<std::mutex> lock{m_mutex};
+
+			// The output id sits between the sealed segments and the new active one, so that on
+			// recovery newer records still override the compacted ones
+			output = m_active + 1;
+
+			if (!platform::sync(m_writer) || !open_active(m_active + 2)) {
+				return false;
+			}
+
+			live.assign(m_index.begin(), m_index.end());
+			inputs = m_segments;
+			inputs.erase(m_active);
+		}
+
+		std::string data_name = m_base + ".compact.tmp";
+		std::string hint_name = m_base + ".hint.tmp";
+		std::vector<location> moved;
+		moved.reserve(live.size());
+
+		{
+			cfile data{data_name.c_str(), mode::write | mode::binary};
+			cfile hint{hint_name.c_str(), mode::write | mode::binary};
+
+			if (data == nullptr || hint == nullptr) {
+				return false;
+			}
+
+			std::uint64_t offset = 0;
+			std::string value;
+
+			for (const auto &entry : live) {
+
+				const location &from = entry.second;
+				value.resize(from.size);
+
+				if (from.size != 0
+				    && platform::pread(*inputs[from.segment], &value[0], from.size, from.offset)
+				           != from.size) {
+					return false;
+				}
+
+				buffer_view key{entry.first.data(), entry.first.size()};
+				std::string record = make_record(key, value.data(), from.size);
+
+				if (data.fwrite(record.data(), 1, record.size()) != record.size()) {
+					return false;
+				}
+
+				location to{output, from.size, offset + header_size + key.size()};
+				char header[16];
+
+				store_u32(header, static_cast<std::uint32_t>(key.size()));
+				store_u32(header + 4, to.size);
+				store_u32(header + 8, static_cast<std::uint32_t>(to.offset));
+				store_u32(header + 12, static_cast<std::uint32_t>(to.offset >> 32));
+
+				if (hint.fwrite(header) != 16
+				    || hint.fwrite(key.data(), 1, key.size()) != key.size()) {
+					return false;
+				}
+
+				moved.push_back(to);
+				offset += record.size();
+			}
+
+			if (!platform::sync(data) || !platform::sync(hint)) {
+				return false;
+			}
+		}
+
+		if (cfile::rename(data_name.c_str(), filename(output, "data").c_str()) != 0
+		    || cfile::rename(hint_name.c_str(), filename(output, "hint").c_str()) != 0) {
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{m_mutex};
+
+			std::shared_ptr<cfile> segment =
+			    std::make_shared<cfile>(filename(output, "data").c_str(), "rb");
+
+			if (*segment == nullptr) {
+				return false;
+			}
+
+			m_segments[output] = std::move(segment);
+
+			for (std::size_t i = 0; i < live.size(); ++i) {
+
+				auto entry = m_index.find(live[i].first);
+
+				// Keys written or removed during the copy keep their newer state
+				if (entry != m_index.end() && entry->second.segment == live[i].second.segment
+				    && entry->second.offset == live[i].second.offset) {
+					entry->second = moved[i];
+				}
+			}
+
+			for (const auto &input : inputs) {
+				m_segments.erase(input.first);
+			}
+
+			if (!write_first(output)) {
+				return false;
+			}
+
+			m_first = output;
+		}
+
+		for (const auto &input : inputs) {
+			cfile::remove(filename(input.first, "data").c_str());
+			cfile::remove(filename(input.first, "hint").c_str());
+		}
+
+		return true;
+	}
+
+public:
+	kvlog() noexcept : m_active_size{0}, m_active{0}, m_first{0}, m_dirty{false} {}
+
+	kvlog(const kvlog &) = delete;
+
+	kvlog &operator=(const kvlog &) = delete;
+
+	~kvlog() {
+		close();
+	}
+
+	// Opens or creates the store whose files start with base and rebuilds the index. Writes always
+	// go to a fresh segment, so a damaged tail left by a crash is never appended to. Returns false
+	// on an I/O error or if memory runs out.
+	bool open(const char *base, options settings = options{}) noexcept {
+
+		try {
+			return open_store(base, settings);
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+	}
+
+	void close() noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		m_writer.reset();
+		m_segments.clear();
+		m_index.clear();
+	}
+
+	// Keys and values must be shorter than 4 GiB - 1 bytes, the largest value being the tombstone
+	// marker. Returns false for larger ones, on a write error or if memory runs out.
+	bool put(buffer_view key, buffer_view value) noexcept {
+
+		if (key.size() >= tombstone || value.size() >= tombstone) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		try {
+
+			// Make room in the index first, so a failure cannot leave a record it does not know
+			auto slot = m_index.emplace(std::string{key.data(), key.size()}, location{});
+			location result;
+
+			if (!append(key, value.data(), static_cast<std::uint32_t>(value.size()), result)) {
+
+				if (slot.second) {
+					m_index.erase(slot.first);
+				}
+
+				return false;
+			}
+
+			slot.first->second = result;
+
+			return true;
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+	}
+
+	// Returns false if the key was not present, on a write error or if memory runs out
+	bool remove(buffer_view key) noexcept {
+
+		if (key.size() >= tombstone) {
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		try {
+
+			auto entry = m_index.find(std::string{key.data(), key.size()});
+
+			if (entry == m_index.end()) {
+				return false;
+			}
+
+			location result;
+
+			if (!append(key, nullptr, tombstone, result)) {
+				return false;
+			}
+
+			m_index.erase(entry);
+
+			return true;
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+	}
+
+	// Reads the value with one positional read outside the lock. Returns false if the key is not
+	// present, the read fails or memory runs out.
+	bool get(buffer_view key, std::string &value) noexcept {
+
+		location found;
+		std::shared_ptr<cfile> segment;
+
+		try {
+
+			{
+				std::lock_guard<std::mutex> lock{m_mutex};
+
+				auto entry = m_index.find(std::string{key.data(), key.size()});
+
+				if (entry == m_index.end()) {
+					return false;
+				}
+
+				found = entry->second;
+				segment = m_segments[found.segment];
+
+				if (found.segment == m_active && m_dirty) {
+					m_writer.fflush();
+					m_dirty = false;
+				}
+			}
+
+			value.resize(found.size);
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+
+		return found.size == 0
+		       || platform::pread(*segment, &value[0], found.size, found.offset) == found.size;
+	}
+
+	// Also false if memory for the lookup key runs out
+	[[nodiscard]] bool contains(buffer_view key) const noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		try {
+			return m_index.find(std::string{key.data(), key.size()}) != m_index.end();
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+	}
+
+	[[nodiscard]] std::size_t size() const noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		return m_index.size();
+	}
+
+	// Puts every record written so far on stable storage
+	bool sync() noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		m_dirty = false;
+
+		return platform::sync(m_writer);
+	}
+
+	// Rewrites the live records of every segment written before the call into a single new
+	// segment with a hint file, then deletes the old segments. Only the start and the end take the
+	// store lock; puts, removes and gets proceed while values are copied.
+	bool compact() noexcept {
+
+		try {
+			return compact_segments();
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+	}
+};
+
+} // namespace xtr
+
+
+#endif // KVLOG_HPP
@@ -0,0 +1,473 @@
+#pragma once
+#ifndef LINE_COUNTER_HPP
+#define LINE_COUNTER_HPP
+
+
+#include "buffer_view.hpp"
+#include "buffered_reader.hpp"
+#include "cfile.hpp"
+#include "hash.hpp"
+#include "merge.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+struct line_counter_options {
+	// Temporary files the table is split into when it outgrows the memory budget; at least one
+	std::size_t partitions = 64;
+	// Write buffer of each partition
+	std::size_t spill_buffer = 64 * 1024;
+	// Read buffer for input lines and for reading partitions back
+	std::size_t read_ahead = 1024 * 1024;
+};
+
+// Counts the occurrences of each distinct line, the engine behind uniq and sort | uniq -c. Lines
+// are hashed into an open-addressing table whose entries, a count and a length followed by the
+// bytes, are carved out of large arena blocks, so adding a line allocates nothing unless it is new
+// and then only bumps a pointer.
+//
+// When the table and arena outgrow the memory budget, every entry is appended to one of a number
+// of partition files chosen by its hash, and the table starts over empty. for_each then reads the
+// partitions back one at a time, merging the counts of each with a table hashed with a different
+// seed; a partition that is itself too large is split again the same way. Each distinct line thus
+// only has to fit in memory together with the lines of its partition.
+class line_counter {
+private:
+	using options = line_counter_options;
+
+	struct slot {
+		std::uint64_t hash;
+		char *entry;
+	};
+
+	struct block {
+		std::unique_ptr<char[]> data;
+		std::size_t size;
+	};
+
+	struct spill_set {
+		std::deque<cfile> files;
+		std::deque<detail::record_output> outputs;
+	};
+
+	static constexpr std::size_t header_size = 16;
+	static constexpr std::size_t block_size = 1024 * 1024;
+	static constexpr std::size_t initial_capacity = 1024;
+	// Past this depth partitions are no longer split and may exceed the budget
+	static constexpr unsigned max_level = 4;
+
+	std::unique_ptr<slot[]> m_slots;
+	std::size_t m_capacity;
+	std::size_t m_size;
+	std::vector<block> m_blocks;
+	std::size_t m_block;
+	std::size_t m_used;
+	std::size_t m_arena_size;
+	std::unique_ptr<spill_set> m_spill;
+	options m_options;
+	std::size_t m_memory_budget;
+	unsigned m_level;
+	bool m_spilled;
+	bool m_error;
+
+	[[nodiscard]] static std::uint64_t load(const char *entry, std::size_t offset) noexcept {
+
+		std::uint64_t value;
+		std::memcpy(&value, entry + offset, sizeof(value));
+
+		return value;
+	}
+
+	static void store(char *entry, std::size_t offset, std::uint64_t value) noexcept {
+		std::memcpy(entry + offset, &value, sizeof(value));
+	}
+
+	[[nodiscard]] std::size_t memory() const noexcept {
+		return m_arena_size + m_capacity * sizeof(slot);
+	}
+
+	// Carves size bytes out of the arena, reusing blocks kept from before the last reset
+	char *allocate(std::size_t size) noexcept {
+
+		size = (size + 7) & ~std::size_t{7};
+
+		while (m_block < m_blocks.size() && m_blocks[m_block].size - m_used < size) {
+			m_arena_size += m_blocks[m_block].size - m_used;
+			++m_block;
+			m_used = 0;
+		}
+
+		if (m_block == m_blocks.size()) {
+
+			std::size_t capacity = block_size;
+
+			if (size > capacity) {
+				capacity = size;
+			}
+
+			std::unique_ptr<char[]> data{new (std::nothrow) char[capacity]};
+
+			if (data == nullptr) {
+				return nullptr;
+			}
+
+			m_blocks.push_back(block{std::move(data), capacity});
+		}
+
+		char *result = m_blocks[m_block].data.get() + m_used;
+
+		m_used += size;
+		m_arena_size += size;
+
+		return result;
+	}
+
+	bool grow() noexcept {
+
+		std::size_t capacity = 2 * m_capacity;
+		std::unique_ptr<slot[]> slots{new (std::nothrow) slot[capacity]()};
+
+		if (slots == nullptr) {
+			return false;
+		}
+
+		for (std::size_t i = 0; i < m_capacity; ++i) {
+
+			if (m_slots[i].entry == nullptr) {
+				continue;
+			}
+
+			std::size_t index = m_slots[i].hash & (capacity - 1);
+
+			while (slots[index].entry != nullptr) {
+				index = (index + 1) & (capacity - 1);
+			}
+
+			slots[index] = m_slots[i];
+		}
+
+		m_slots = std::move(slots);
+		m_capacity = capacity;
+
+		return true;
+	}
+
+	// Empties the table, shrinking it back to its initial size so that a table grown past the
+	// budget does not make every later insert spill
+	void clear() noexcept {
+
+		if (m_capacity > initial_capacity) {
+
+			std::unique_ptr<slot[]> slots{new (std::nothrow) slot[initial_capacity]()};
+
+			if (slots != nullptr) {
+				m_slots = std::move(slots);
+				m_capacity = initial_capacity;
+			}
+		}
+
+		for (std::size_t i = 0; i < m_capacity; ++i) {
+			m_slots[i].entry = nullptr;
+		}
+
+		m_size = 0;
+		m_block = 0;
+		m_used = 0;
+		m_arena_size = 0;
+	}
+
+	// Appends every entry to its partition and empties the table
+	void spill() noexcept {
+
+		if (m_spill == nullptr) {
+
+			m_spill.reset(new (std::nothrow) spill_set);
+
+			if (m_spill == nullptr) {
+				m_error = true;
+				return;
+			}
+
+			for (std::size_t i = 0; i < m_options.partitions; ++i) {
+
+				m_spill->files.push_back(cfile::tmpfile());
+
+				if (m_spill->files.back() == nullptr) {
+					m_error = true;
+				}
+
+				m_spill->outputs.emplace_back(m_spill->files.back(), false, m_options.spill_buffer);
+			}
+		}
+
+		m_spilled = true;
+
+		if (!m_error) {
+
+			for (std::size_t i = 0; i < m_capacity; ++i) {
+
+				const char *entry = m_slots[i].entry;
+
+				if (entry == nullptr) {
+					continue;
+				}
+
+				detail::record_output &output =
+				    m_spill->outputs[(m_slots[i].hash >> 32) % m_options.partitions];
+
+				output.write(buffer_view{entry, header_size + load(entry, 8)});
+			}
+		}
+
+		clear();
+	}
+
+	bool insert(const char *data, std::size_t size, std::uint64_t count) noexcept {
+
+		std::uint64_t hash = hash_bytes(data, size, m_level);
+		std::size_t index = hash & (m_capacity - 1);
+
+		for (; m_slots[index].entry != nullptr; index = (index + 1) & (m_capacity - 1)) {
+
+			char *entry = m_slots[index].entry;
+
+			if (m_slots[index].hash == hash && load(entry, 8) == size
+			    && (size == 0 || std::memcmp(entry + header_size, data, size) == 0)) {
+				store(entry, 0, load(entry, 0) + count);
+				return true;
+			}
+		}
+
+		// Keep the load factor at most 3/4
+		if ((m_size + 1) * 4 > m_capacity * 3) {
+
+			if (!grow()) {
+				m_error = true;
+				return false;
+			}
+
+			index = hash & (m_capacity - 1);
+
+			while (m_slots[index].entry != nullptr) {
+				index = (index + 1) & (m_capacity - 1);
+			}
+		}
+
+		char *entry = allocate(header_size + size);
+
+		if (entry == nullptr) {
+			m_error = true;
+			return false;
+		}
+
+		store(entry, 0, count);
+		store(entry, 8, size);
+
+		if (size != 0) {
+			std::memcpy(entry + header_size, data, size);
+		}
+
+		m_slots[index] = slot{hash, entry};
+		++m_size;
+
+		if (memory() > m_memory_budget && m_level < max_level) {
+			spill();
+		}
+
+		return !m_error;
+	}
+
+	// Hands the table to fn, then reads back and hands over each partition in turn
+	template <typename Function>
+	void drain(Function &fn) {
+
+		if (m_spill == nullptr) {
+
+			for (std::size_t i = 0; i < m_capacity; ++i) {
+
+				const char *entry = m_slots[i].entry;
+
+				if (entry != nullptr) {
+					fn(buffer_view{entry + header_size, load(entry, 8)}, load(entry, 0));
+				}
+			}
+
+			clear();
+			return;
+		}
+
+		spill();
+
+		std::unique_ptr<spill_set> partitions = std::move(m_spill);
+
+		for (detail::record_output &output : partitions->outputs) {
+			m_error = !output.flush() || m_error;
+		}
+
+		partitions->outputs.clear();
+
+		unsigned level = m_level;
+
+		for (cfile &file : partitions->files) {
+
+			if (m_error) {
+				break;
+			}
+
+			file.rewind();
+			m_level = level + 1;
+
+			buffered_reader reader{file, m_options.read_ahead};
+
+			for (;;) {
+
+				buffer_view header = reader.peek(header_size);
+
+				if (header.size() < header_size) {
+					m_error = !header.empty() || m_error;
+					break;
+				}
+
+				std::uint64_t count = load(header.data(), 0);
+				std::size_t size = load(header.data(), 8);
+				buffer_view entry = reader.peek(header_size + size);
+
+				if (entry.size() < header_size + size) {
+					m_error = true;
+					break;
+				}
+
+				insert(entry.data() + header_size, size, count);
+				reader.consume(header_size + size);
+			}
+
+			m_error = reader.error() || m_error;
+
+			drain(fn);
+
+			m_level = level;
+			file.fclose();
+		}
+	}
+
+public:
+	// The budget covers the table and the arena holding the lines. It is raised to at least twice
+	// the size of the initial table, below which every line would spill on its own.
+	explicit line_counter(std::size_t memory_budget = 256 * 1024 * 1024,
+	                      options settings = options{}) noexcept :
+	    m_slots{new (std::nothrow) slot[initial_capacity]()},
+	    m_capacity{m_slots != nullptr ? initial_capacity : 0}, m_size{0}, m_block{0}, m_used{0},
+	    m_arena_size{0}, m_options{settings},
+	    m_memory_budget{std::max(memory_budget, 2 * initial_capacity * sizeof(slot))}, m_level{0},
+	    m_spilled{false}, m_error{m_slots == nullptr} {
+
+		if (m_options.partitions == 0) {
+			m_options.partitions = 1;
+		}
+	}
+
+	line_counter(const line_counter &) = delete;
+
+	line_counter &operator=(const line_counter &) = delete;
+
+	// Counts count more occurrences of line. Returns false on an allocation or write failure.
+	bool add(buffer_view line, std::uint64_t count = 1) noexcept {
+
+		if (m_error) {
+			return false;
+		}
+
+		return insert(line.data(), line.size(), count);
+	}
+
+	// Counts every line of the file; lines exclude their '\n'
+	bool add_lines(cfile &in) noexcept {
+
+		detail::record_cursor cursor{in, 0, m_options.read_ahead};
+
+		while (!m_error && cursor.next()) {
+			buffer_view line = cursor.current();
+			insert(line.data(), line.size(), 1);
+		}
+
+		m_error = cursor.error() || m_error;
+
+		return !m_error;
+	}
+
+	// Calls fn(line, count) once per distinct line, in no particular order, and empties the
+	// counter. The line view is only valid during the call. Returns false if an error occurred
+	// while adding lines or reading back partitions.
+	template <typename Function>
+	bool for_each(Function fn) {
+
+		if (!m_error) {
+			drain(fn);
+		}
+
+		m_spilled = false;
+
+		return !m_error;
+	}
+
+	// Number of distinct lines in memory, not counting spilled partitions
+	[[nodiscard]] std::size_t size() const noexcept {
+		return m_size;
+	}
+
+	// Whether the table has outgrown the budget and been spilled to disk
+	[[nodiscard]] bool spilled() const noexcept {
+		return m_spilled;
+	}
+
+	[[nodiscard]] bool error() const noexcept {
+		return m_error;
+	}
+};
+
+// Writes each distinct line of in to out once. Unlike sort | uniq the lines come out in no
+// particular order; sort them afterwards if order matters. With counts each line is preceded by
+// its number of occurrences, formatted as uniq -c does.
+inline bool uniq(cfile &in, cfile &out, bool counts = false,
+                 std::size_t memory_budget = 256 * 1024 * 1024) {
+
+	line_counter counter{memory_budget};
+	detail::record_output output{out, false, 1024 * 1024};
+
+	if (!counter.add_lines(in)) {
+		return false;
+	}
+
+	bool result = counter.for_each([&](buffer_view line, std::uint64_t count) {
+
+		if (counts) {
+			char prefix[32];
+			int size = std::snprintf(prefix, sizeof(prefix), "%7llu ",
+			                         static_cast<unsigned long long>(count));
+			output.write(buffer_view{prefix, static_cast<std::size_t>(size)});
+		}
+
+		output.write(line);
+		output.write(buffer_view{"\n", 1});
+	});
+
+	return output.flush() && result;
+}
+
+} // namespace xtr
+
+
+#endif // LINE_COUNTER_HPP
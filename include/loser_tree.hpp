@@ -0,0 +1,128 @@
+#pragma once
+#ifndef LOSER_TREE_HPP
+#define LOSER_TREE_HPP
+
+
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Tournament tree of losers for k-way merging. Each inner node remembers the loser of the match
+// played there and the overall winner sits at the root, so after the winning source advances only
+// the matches on its path to the root are replayed: one comparison per level, against a single
+// stored loser, instead of the two per level a binary heap needs.
+//
+// Sources are numbered 0 to k - 1. less(a, b) must say whether the current item of source a comes
+// before that of source b; it is only called for sources that are not exhausted. Ties go to the
+// lower source number, which makes merges stable.
+template <typename Less>
+class loser_tree {
+private:
+	std::vector<std::size_t> m_losers;
+	std::vector<bool> m_exhausted;
+	std::size_t m_winner;
+	std::size_t m_remaining;
+	Less m_less;
+
+	[[nodiscard]] bool beats(std::size_t a, std::size_t b) {
+
+		if (m_exhausted[a] || m_exhausted[b]) {
+			return !m_exhausted[a];
+		}
+
+		return m_less(a, b) || (!m_less(b, a) && a < b);
+	}
+
+	// Plays the matches below node, storing losers, and returns the winner. Leaves are at
+	// k + source.
+	std::size_t play(std::size_t node) {
+
+		std::size_t count = m_exhausted.size();
+
+		if (node >= count) {
+			return node - count;
+		}
+
+		std::size_t left = play(2 * node);
+		std::size_t right = play(2 * node + 1);
+
+		if (beats(left, right)) {
+			m_losers[node] = right;
+			return left;
+		}
+
+		m_losers[node] = left;
+		return right;
+	}
+
+public:
+	explicit loser_tree(Less less = Less{}) :
+	    m_winner{0}, m_remaining{0}, m_less{std::move(less)} {}
+
+	// Starts a tournament over count sources, each of which must have a current item or be
+	// marked exhausted in exhausted
+	void build(std::size_t count, const std::vector<bool> &exhausted) {
+
+		m_exhausted = exhausted;
+		m_exhausted.resize(count, false);
+		m_losers.assign(count, 0);
+		m_remaining = 0;
+
+		for (std::size_t i = 0; i < count; ++i) {
+			m_remaining += m_exhausted[i] ? 0 : 1;
+		}
+
+		m_winner = count == 0 ? 0 : count == 1 ? 0 : play(1);
+	}
+
+	void build(std::size_t count) {
+		build(count, std::vector<bool>(count, false));
+	}
+
+	[[nodiscard]] bool empty() const noexcept {
+		return m_remaining == 0;
+	}
+
+	// Source whose current item comes first; only meaningful while not empty
+	[[nodiscard]] std::size_t top() const noexcept {
+		return m_winner;
+	}
+
+	// Call after the top source has moved on to its next item
+	void replay() {
+
+		std::size_t winner = m_winner;
+
+		for (std::size_t node = (winner + m_exhausted.size()) / 2; node != 0; node /= 2) {
+
+			if (beats(m_losers[node], winner)) {
+				std::swap(m_losers[node], winner);
+			}
+		}
+
+		m_winner = winner;
+	}
+
+	// Call when the top source has no more items
+	void exhaust() {
+
+		m_exhausted[m_winner] = true;
+		--m_remaining;
+
+		replay();
+	}
+
+	[[nodiscard]] Less &less() noexcept {
+		return m_less;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // LOSER_TREE_HPP
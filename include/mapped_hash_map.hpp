@@ -0,0 +1,441 @@
+#pragma once
+#ifndef MAPPED_HASH_MAP_HPP
+#define MAPPED_HASH_MAP_HPP
+
+
+#include "cfile.hpp"
+#include "hash.hpp"
+#include "platform.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+#if defined(XTR_POSIX)
+
+// 'extra' namespace
+namespace xtr {
+
+namespace detail {
+
+struct mapped_hash_map_header {
+	std::uint64_t magic;
+	std::uint64_t key_size;
+	std::uint64_t value_size;
+	std::uint64_t bucket_count;
+	std::atomic<std::uint64_t> size;
+	std::uint64_t reserved[3];
+};
+
+template <typename Key, typename Value>
+struct mapped_hash_map_slot {
+	// Odd while a writer is changing the slot
+	std::atomic<std::uint32_t> version;
+	std::uint32_t state;
+	Key key;
+	Value value;
+};
+
+} // namespace detail
+
+// Hash map with a fixed number of buckets and linear probing, kept in a file mapped shared into
+// memory, so it is ready as soon as the file is opened and can be shared by many processes. Keys
+// are hashed and compared by their bytes, so they must have no padding.
+//
+// Readers take no locks: every slot carries a version that writers make odd while they change it,
+// and a reader copies the slot and retries if the version moved. Readers give up on a slot that
+// stays odd, which only happens when a writer died while changing it, and the next write to the
+// slot makes its version even again. Writers are serialised across processes by an advisory lock
+// on the file and within the process by a mutex. The map does not grow; insert() fails when no
+// free bucket is left. Removed entries leave tombstones that later inserts reuse.
+//
+// The cfile should be opened with mode::read | mode::binary | mode::extended, or mode::write |
+// mode::binary | mode::extended to create a new map. A process that only reads can open the map
+// read-only from a file opened with mode::read | mode::binary; the file is then mapped without
+// write access and insert() and erase() fail. The cfile is not owned and must stay open while the
+// map is.
+template <typename Key, typename Value>
+class mapped_hash_map {
+	static_assert(std::is_trivially_copyable<Key>::value
+	                  && std::is_trivially_copyable<Value>::value,
+	              "mapped_hash_map keys and values must be trivially copyable");
+	static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+	              "mapped_hash_map needs address-free atomics to share memory between processes");
+
+private:
+	using header = detail::mapped_hash_map_header;
+	using slot = detail::mapped_hash_map_slot<Key, Value>;
+
+	enum : std::uint32_t { empty_slot = 0, occupied_slot = 1, removed_slot = 2 };
+
+	static constexpr std::size_t max_load_attempts = 1 << 16;
+
+	cfile *m_file;
+	char *m_mapping;
+	std::size_t m_mapping_size;
+	std::mutex m_mutex;
+	bool m_read_only;
+
+	[[nodiscard]] header *get_header() const noexcept {
+		return reinterpret_cast<header *>(m_mapping);
+	}
+
+	[[nodiscard]] slot *slots() const noexcept {
+		return reinterpret_cast<slot *>(m_mapping + header_size);
+	}
+
+	[[nodiscard]] static std::uint64_t hash(const Key &key) noexcept {
+		return hash_bytes(&key, sizeof(Key));
+	}
+
+	[[nodiscard]] static bool equal(const Key &lhs, const Key &rhs) noexcept {
+		return std::memcmp(&lhs, &rhs, sizeof(Key)) == 0;
+	}
+
+	// Copies a consistent snapshot of the slot. Returns false if the slot stayed odd or kept
+	// changing for max_load_attempts tries, as it does when a writer died while changing it.
+	[[nodiscard]] static bool load(const slot &source, std::uint32_t &state, Key &key,
+	                               Value &value) noexcept {
+
+		for (std::size_t attempt = 0; attempt < max_load_attempts; ++attempt) {
+
+			std::uint32_t version = source.version.load(std::memory_order_acquire);
+
+			if ((version & 1) != 0) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			state = source.state;
+			std::memcpy(&key, &source.key, sizeof(Key));
+			std::memcpy(&value, &source.value, sizeof(Value));
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (source.version.load(std::memory_order_relaxed) == version) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Runs change between making the slot version odd and even again. Called under the write
+	// lock, so an odd version can only be left by a writer that died; it is rounded up to even.
+	template <typename Change>
+	static void modify(slot &target, Change change) noexcept {
+
+		std::uint32_t version = target.version.load(std::memory_order_relaxed);
+		version += version & 1;
+
+		target.version.store(version + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		change(target);
+
+		target.version.store(version + 2, std::memory_order_release);
+	}
+
+	static void store(slot &target, const Key &key, const Value &value) noexcept {
+
+		modify(target, [&](slot &changed) {
+			changed.state = occupied_slot;
+			std::memcpy(&changed.key, &key, sizeof(Key));
+			std::memcpy(&changed.value, &value, sizeof(Value));
+		});
+	}
+
+	// Holds the in-process mutex and the file lock for one write
+	class write_lock {
+	private:
+		mapped_hash_map *m_map;
+		bool m_locked;
+
+	public:
+		explicit write_lock(mapped_hash_map &map) noexcept : m_map{&map} {
+			m_map->m_mutex.lock();
+			m_locked = platform::lock(*m_map->m_file);
+		}
+
+		write_lock(const write_lock &) = delete;
+
+		write_lock &operator=(const write_lock &) = delete;
+
+		~write_lock() {
+
+			if (m_locked) {
+				platform::unlock(*m_map->m_file);
+			}
+
+			m_map->m_mutex.unlock();
+		}
+
+		[[nodiscard]] bool locked() const noexcept {
+			return m_locked;
+		}
+	};
+
+	bool map_file(cfile &file, std::size_t size, bool read_only) noexcept {
+
+		void *mapping = platform::map(file, size, !read_only);
+
+		if (mapping == nullptr) {
+			return false;
+		}
+
+		m_file = &file;
+		m_mapping = static_cast<char *>(mapping);
+		m_mapping_size = size;
+		m_read_only = read_only;
+
+		return true;
+	}
+
+public:
+	static constexpr std::uint64_t magic = 0x3170616d68727478ull;
+	static constexpr std::size_t header_size = sizeof(header);
+
+	mapped_hash_map() noexcept :
+	    m_file{nullptr}, m_mapping{nullptr}, m_mapping_size{0}, m_read_only{false} {}
+
+	mapped_hash_map(const mapped_hash_map &) = delete;
+
+	mapped_hash_map &operator=(const mapped_hash_map &) = delete;
+
+	~mapped_hash_map() {
+		close();
+	}
+
+	// Sizes the file for bucket_count buckets, rounded up to a power of two, and maps an empty map.
+	// Any previous contents of the file are discarded.
+	bool create(cfile &file, std::size_t bucket_count) noexcept {
+
+		close();
+
+		std::size_t buckets = 1;
+
+		while (buckets < bucket_count) {
+			buckets *= 2;
+		}
+
+		std::size_t size = header_size + buckets * sizeof(slot);
+
+		if (!platform::truncate(file, 0) || !platform::truncate(file, size)
+		    || !map_file(file, size, false)) {
+			return false;
+		}
+
+		header &created = *get_header();
+		created.key_size = sizeof(Key);
+		created.value_size = sizeof(Value);
+		created.bucket_count = buckets;
+		created.size.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		created.magic = magic;
+
+		return true;
+	}
+
+	// Maps a map made by create(), without write access if read_only. Returns false if the file
+	// holds something else.
+	bool open(cfile &file, bool read_only = false) noexcept {
+
+		close();
+
+		std::uint64_t size = platform::file_size(file);
+
+		if (size < header_size || !map_file(file, size, read_only)) {
+			return false;
+		}
+
+		const header &existing = *get_header();
+
+		if (existing.magic != magic || existing.key_size != sizeof(Key)
+		    || existing.value_size != sizeof(Value) || existing.bucket_count == 0
+		    || (existing.bucket_count & (existing.bucket_count - 1)) != 0
+		    || header_size + existing.bucket_count * sizeof(slot) > size) {
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void close() noexcept {
+
+		platform::unmap(m_mapping, m_mapping_size);
+
+		m_file = nullptr;
+		m_mapping = nullptr;
+		m_mapping_size = 0;
+		m_read_only = false;
+	}
+
+	[[nodiscard]] bool is_open() const noexcept {
+		return m_mapping != nullptr;
+	}
+
+	[[nodiscard]] bool read_only() const noexcept {
+		return m_read_only;
+	}
+
+	[[nodiscard]] std::size_t size() const noexcept {
+		return static_cast<std::size_t>(get_header()->size.load(std::memory_order_relaxed));
+	}
+
+	[[nodiscard]] std::size_t bucket_count() const noexcept {
+		return static_cast<std::size_t>(get_header()->bucket_count);
+	}
+
+	// Lock-free; may run concurrently with writers in this or other processes
+	bool find(const Key &key, Value &value) const noexcept {
+
+		std::size_t mask = bucket_count() - 1;
+		std::size_t index = static_cast<std::size_t>(hash(key)) & mask;
+
+		for (std::size_t probe = 0; probe <= mask; ++probe, index = (index + 1) & mask) {
+
+			std::uint32_t state;
+			Key found;
+			Value found_value;
+
+			// A slot left half-written by a dead writer is passed over
+			if (!load(slots()[index], state, found, found_value)) {
+				continue;
+			}
+
+			if (state == empty_slot) {
+				return false;
+			}
+
+			if (state == occupied_slot && equal(found, key)) {
+				value = found_value;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	[[nodiscard]] bool contains(const Key &key) const noexcept {
+
+		Value ignored;
+
+		return find(key, ignored);
+	}
+
+	// Inserts the key or replaces its value. Returns false if the map is full or read-only, or the
+	// file lock could not be taken.
+	bool insert(const Key &key, const Value &value) noexcept {
+
+		if (m_read_only) {
+			return false;
+		}
+
+		write_lock lock{*this};
+
+		if (!lock.locked()) {
+			return false;
+		}
+
+		std::size_t mask = bucket_count() - 1;
+		std::size_t index = static_cast<std::size_t>(hash(key)) & mask;
+		std::size_t free = mask + 1;
+
+		for (std::size_t probe = 0; probe <= mask; ++probe, index = (index + 1) & mask) {
+
+			slot &current = slots()[index];
+
+			if (current.state == occupied_slot && equal(current.key, key)) {
+				store(current, key, value);
+				return true;
+			}
+
+			if (current.state != occupied_slot && free > mask) {
+				free = index;
+			}
+
+			if (current.state == empty_slot) {
+				break;
+			}
+		}
+
+		if (free > mask) {
+			return false;
+		}
+
+		store(slots()[free], key, value);
+		get_header()->size.fetch_add(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// Returns false if the key was not present, the map is read-only or the file lock could not be
+	// taken
+	bool erase(const Key &key) noexcept {
+
+		if (m_read_only) {
+			return false;
+		}
+
+		write_lock lock{*this};
+
+		if (!lock.locked()) {
+			return false;
+		}
+
+		std::size_t mask = bucket_count() - 1;
+		std::size_t index = static_cast<std::size_t>(hash(key)) & mask;
+
+		for (std::size_t probe = 0; probe <= mask; ++probe, index = (index + 1) & mask) {
+
+			slot &current = slots()[index];
+
+			if (current.state == empty_slot) {
+				return false;
+			}
+
+			if (current.state == occupied_slot && equal(current.key, key)) {
+				modify(current, [](slot &changed) { changed.state = removed_slot; });
+				get_header()->size.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Calls function(key, value) for every entry. Entries written meanwhile may or may not be seen.
+	template <typename Function>
+	void for_each(Function function) const {
+
+		for (std::size_t i = 0; i < bucket_count(); ++i) {
+
+			std::uint32_t state;
+			Key key;
+			Value value;
+
+			if (load(slots()[i], state, key, value) && state == occupied_slot) {
+				function(key, value);
+			}
+		}
+	}
+
+	// Writes modified pages back to the file, waiting for the disk unless wait is false
+	bool sync(bool wait = true) noexcept {
+		return m_mapping == nullptr || platform::sync_mapping(m_mapping, m_mapping_size, wait);
+	}
+};
+
+} // namespace xtr
+
+#endif // XTR_POSIX
+
+
+#endif // MAPPED_HASH_MAP_HPP
@@ -0,0 +1,292 @@
+#pragma once
+#ifndef MAPPED_VECTOR_HPP
+#define MAPPED_VECTOR_HPP
+
+
+#include "cfile.hpp"
+#include "platform.hpp"
+
+#include <type_traits>
+#include <utility>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+
+#if defined(XTR_POSIX)
+
+// 'extra' namespace
+namespace xtr {
+
+namespace detail {
+
+struct mapped_vector_header {
+	std::uint64_t magic;
+	std::uint64_t element_size;
+	std::uint64_t size;
+	std::uint64_t reserved[5];
+};
+
+} // namespace detail
+
+// Vector of trivially copyable elements kept in a file mapped shared into memory. Opening maps the
+// file, so reopening is immediate however large it is and the pages are shared with every other
+// process mapping it. The file starts with a 64-byte header holding a magic number, the element
+// size and the element count in native byte order, followed by the elements; the file size sets
+// the capacity. Growing extends the file with ftruncate and the mapping with mremap, doubling the
+// capacity each time.
+//
+// Pointers and references to elements are invalidated by growth. The cfile should be opened with
+// mode::read | mode::binary | mode::extended, or mode::write | mode::binary | mode::extended for a
+// new file, and is not owned; it must stay open while the vector is.
+template <typename Type>
+class mapped_vector {
+	static_assert(std::is_trivially_copyable<Type>::value,
+	              "mapped_vector elements must be trivially copyable");
+
+private:
+	using header = detail::mapped_vector_header;
+
+	cfile *m_file;
+	char *m_mapping;
+	std::size_t m_mapping_size;
+
+	[[nodiscard]] header *get_header() const noexcept {
+		return reinterpret_cast<header *>(m_mapping);
+	}
+
+	// Grows file and mapping to mapping_size bytes
+	bool grow(std::size_t mapping_size) noexcept {
+
+		if (!platform::truncate(*m_file, mapping_size)) {
+			return false;
+		}
+
+		void *mapping = m_mapping == nullptr
+		                    ? platform::map(*m_file, mapping_size)
+		                    : platform::remap(*m_file, m_mapping, m_mapping_size, mapping_size);
+
+		if (mapping == nullptr) {
+			return false;
+		}
+
+		m_mapping = static_cast<char *>(mapping);
+		m_mapping_size = mapping_size;
+
+		return true;
+	}
+
+public:
+	static constexpr std::uint64_t magic = 0x3163657676727478ull;
+	static constexpr std::size_t header_size = sizeof(header);
+	static constexpr std::size_t initial_capacity = 1024;
+
+	mapped_vector() noexcept : m_file{nullptr}, m_mapping{nullptr}, m_mapping_size{0} {}
+
+	mapped_vector(const mapped_vector &) = delete;
+
+	mapped_vector(mapped_vector &&other) noexcept :
+	    m_file{std::exchange(other.m_file, nullptr)},
+	    m_mapping{std::exchange(other.m_mapping, nullptr)},
+	    m_mapping_size{std::exchange(other.m_mapping_size, 0)} {}
+
+	mapped_vector &operator=(const mapped_vector &) = delete;
+
+	mapped_vector &operator=(mapped_vector &&other) noexcept {
+
+		if (this != &other) {
+			close();
+			m_file = std::exchange(other.m_file, nullptr);
+			m_mapping = std::exchange(other.m_mapping, nullptr);
+			m_mapping_size = std::exchange(other.m_mapping_size, 0);
+		}
+
+		return *this;
+	}
+
+	~mapped_vector() {
+		close();
+	}
+
+	// Maps an existing vector file, or initialises an empty file. Returns false if the file holds
+	// something else or cannot be mapped.
+	bool open(cfile &file) noexcept {
+
+		close();
+
+		std::uint64_t size = platform::file_size(file);
+
+		m_file = &file;
+
+		if (size == 0) {
+
+			if (!grow(header_size + initial_capacity * sizeof(Type))) {
+				close();
+				return false;
+			}
+
+			*get_header() = header{magic, sizeof(Type), 0, {}};
+
+			return true;
+		}
+
+		void *mapping = size >= header_size ? platform::map(file, size) : nullptr;
+
+		if (mapping == nullptr) {
+			m_file = nullptr;
+			return false;
+		}
+
+		m_mapping = static_cast<char *>(mapping);
+		m_mapping_size = size;
+
+		const header &existing = *get_header();
+
+		if (existing.magic != magic || existing.element_size != sizeof(Type)
+		    || existing.size > capacity()) {
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	// Unmaps without syncing; the operating system still writes modified pages back in its own
+	// time
+	void close() noexcept {
+
+		platform::unmap(m_mapping, m_mapping_size);
+
+		m_file = nullptr;
+		m_mapping = nullptr;
+		m_mapping_size = 0;
+	}
+
+	[[nodiscard]] bool is_open() const noexcept {
+		return m_mapping != nullptr;
+	}
+
+	[[nodiscard]] std::size_t size() const noexcept {
+		return m_mapping != nullptr ? static_cast<std::size_t>(get_header()->size) : 0;
+	}
+
+	[[nodiscard]] bool empty() const noexcept {
+		return size() == 0;
+	}
+
+	[[nodiscard]] std::size_t capacity() const noexcept {
+		return m_mapping != nullptr ? (m_mapping_size - header_size) / sizeof(Type) : 0;
+	}
+
+	[[nodiscard]] Type *data() noexcept {
+		return reinterpret_cast<Type *>(m_mapping + header_size);
+	}
+
+	[[nodiscard]] const Type *data() const noexcept {
+		return reinterpret_cast<const Type *>(m_mapping + header_size);
+	}
+
+	[[nodiscard]] Type *begin() noexcept {
+		return data();
+	}
+
+	[[nodiscard]] const Type *begin() const noexcept {
+		return data();
+	}
+
+	[[nodiscard]] Type *end() noexcept {
+		return data() + size();
+	}
+
+	[[nodiscard]] const Type *end() const noexcept {
+		return data() + size();
+	}
+
+	[[nodiscard]] Type &operator[](std::size_t index) noexcept {
+
+		assert(index < size());
+
+		return data()[index];
+	}
+
+	[[nodiscard]] const Type &operator[](std::size_t index) const noexcept {
+
+		assert(index < size());
+
+		return data()[index];
+	}
+
+	// Extends the file so that at least count elements fit
+	bool reserve(std::size_t count) noexcept {
+
+		assert(is_open());
+
+		if (count <= capacity()) {
+			return true;
+		}
+
+		return grow(header_size + count * sizeof(Type));
+	}
+
+	bool push_back(const Type &value) noexcept {
+
+		// value may be an element, which growing can move along with the mapping
+		Type copy = value;
+		std::size_t count = size();
+
+		if (count == capacity() && !reserve(count != 0 ? 2 * count : initial_capacity)) {
+			return false;
+		}
+
+		data()[count] = copy;
+		get_header()->size = count + 1;
+
+		return true;
+	}
+
+	void pop_back() noexcept {
+
+		assert(!empty());
+
+		--get_header()->size;
+	}
+
+	// New elements are value-initialised
+	bool resize(std::size_t count) noexcept {
+
+		std::size_t old_size = size();
+
+		if (count > capacity() && !reserve(count > 2 * old_size ? count : 2 * old_size)) {
+			return false;
+		}
+
+		for (std::size_t i = old_size; i < count; ++i) {
+			data()[i] = Type{};
+		}
+
+		get_header()->size = count;
+
+		return true;
+	}
+
+	void clear() noexcept {
+
+		if (m_mapping != nullptr) {
+			get_header()->size = 0;
+		}
+	}
+
+	// Checkpoint: writes modified pages back to the file, waiting for the disk unless wait is
+	// false
+	bool sync(bool wait = true) noexcept {
+		return m_mapping == nullptr || platform::sync_mapping(m_mapping, m_mapping_size, wait);
+	}
+};
+
+} // namespace xtr
+
+#endif // XTR_POSIX
+
+
+#endif // MAPPED_VECTOR_HPP
@@ -0,0 +1,295 @@
+#pragma once
+#ifndef MERGE_HPP
+#define MERGE_HPP
+
+
+#include "buffer_view.hpp"
+#include "buffered_reader.hpp"
+#include "cfile.hpp"
+#include "loser_tree.hpp"
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+struct merge_options {
+	// Size of each fixed-size record, or zero to merge lines
+	std::size_t record_size = 0;
+	// Read-ahead buffer of each input
+	std::size_t read_ahead = 256 * 1024;
+	// Output buffer, written with one fwrite when full
+	std::size_t write_buffer = 1024 * 1024;
+};
+
+namespace detail {
+
+// Walks the records of a sorted input: lines without their '\n' when record_size is zero, or
+// fixed-size records otherwise. Reads ahead in large blocks so that merging many inputs does not
+// turn into many small reads.
+class record_cursor {
+private:
+	buffered_reader m_reader;
+	std::size_t m_record_size;
+	std::size_t m_consumed;
+	buffer_view m_current;
+
+public:
+	record_cursor(cfile &file, std::size_t record_size, std::size_t read_ahead) noexcept :
+	    m_reader{file, read_ahead}, m_record_size{record_size}, m_consumed{0} {}
+
+	// Moves to the next record. Returns false at the end of the input; a trailing partial
+	// fixed-size record is ignored.
+	bool next() noexcept {
+
+		m_reader.consume(m_consumed);
+		m_consumed = 0;
+
+		if (m_record_size != 0) {
+
+			buffer_view record = m_reader.peek(m_record_size);
+
+			if (record.size() < m_record_size) {
+				return false;
+			}
+
+			m_current = buffer_view{record.data(), m_record_size};
+			m_consumed = m_record_size;
+
+			return true;
+		}
+
+		std::size_t scanned = 0;
+
+		for (;;) {
+
+			buffer_view buffered = m_reader.view();
+			const void *newline = buffered.size() == scanned
+			                          ? nullptr
+			                          : std::memchr(buffered.data() + scanned, '\n',
+			                                        buffered.size() - scanned);
+
+			if (newline != nullptr) {
+				std::size_t size = static_cast<const char *>(newline) - buffered.data();
+				m_current = buffer_view{buffered.data(), size};
+				m_consumed = size + 1;
+				return true;
+			}
+
+			scanned = buffered.size();
+
+			if (m_reader.fill() != 0) {
+				continue;
+			}
+
+			// A full buffer holds a line longer than the read-ahead
+			if (m_reader.size() == m_reader.capacity() && m_reader.capacity() != 0
+			    && m_reader.reserve(2 * m_reader.capacity())) {
+				continue;
+			}
+
+			if (m_reader.empty()) {
+				return false;
+			}
+
+			m_current = m_reader.view();
+			m_consumed = m_current.size();
+
+			return true;
+		}
+	}
+
+	[[nodiscard]] buffer_view current() const noexcept {
+		return m_current;
+	}
+
+	[[nodiscard]] bool error() noexcept {
+		return m_reader.error();
+	}
+};
+
+// Collects records in an owned buffer that goes to the cfile with a single fwrite when full. Lines
+// get a '\n' appended.
+class record_output {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_buffer;
+	std::size_t m_capacity;
+	std::size_t m_size;
+	bool m_lines;
+	bool m_error;
+
+public:
+	record_output(cfile &file, bool lines, std::size_t capacity) noexcept :
+	    m_file{&file}, m_buffer{new (std::nothrow) char[capacity]},
+	    m_capacity{m_buffer != nullptr ? capacity : 0}, m_size{0}, m_lines{lines},
+	    m_error{m_buffer == nullptr} {}
+
+	record_output(const record_output &) = delete;
+
+	record_output &operator=(const record_output &) = delete;
+
+	~record_output() {
+		flush();
+	}
+
+	void write(buffer_view record) noexcept {
+
+		std::size_t size = record.size() + (m_lines ? 1 : 0);
+
+		if (m_capacity - m_size < size) {
+
+			flush();
+
+			// Records larger than the buffer go straight to the file
+			if (size > m_capacity) {
+				m_error = m_error
+				          || m_file->fwrite(record.data(), 1, record.size()) != record.size()
+				          || (m_lines && m_file->fputc('\n') == EOF);
+				return;
+			}
+		}
+
+		if (!record.empty()) {
+			std::memcpy(m_buffer.get() + m_size, record.data(), record.size());
+		}
+
+		m_size += record.size();
+
+		if (m_lines) {
+			m_buffer[m_size++] = '\n';
+		}
+	}
+
+	// Hands buffered records to the cfile; this does not call cfile::fflush
+	bool flush() noexcept {
+
+		if (m_size != 0) {
+			m_error = m_error || m_file->fwrite(m_buffer.get(), 1, m_size) != m_size;
+			m_size = 0;
+		}
+
+		return !m_error;
+	}
+};
+
+// Merges the records of sorted cursors into output with a loser tree. less compares two records.
+template <typename Less>
+bool merge_records(std::vector<record_cursor> &cursors, record_output &output, Less &less) {
+
+	std::vector<bool> exhausted(cursors.size());
+
+	for (std::size_t i = 0; i < cursors.size(); ++i) {
+		exhausted[i] = !cursors[i].next();
+	}
+
+	auto compare = [&](std::size_t a, std::size_t b) {
+		return less(cursors[a].current(), cursors[b].current());
+	};
+
+	loser_tree<decltype(compare)> tree{compare};
+	tree.build(cursors.size(), exhausted);
+
+	while (!tree.empty()) {
+
+		record_cursor &top = cursors[tree.top()];
+
+		output.write(top.current());
+
+		if (top.next()) {
+			tree.replay();
+		}
+		else {
+			tree.exhaust();
+		}
+	}
+
+	bool result = output.flush();
+
+	for (record_cursor &cursor : cursors) {
+		result = result && !cursor.error();
+	}
+
+	return result;
+}
+
+} // namespace detail
+
+// Merges count inputs, each already sorted by key, into out. key maps a record, given as a
+// buffer_view, to a default-constructible value ordered by <; it is called once per record and the
+// result cached while the record waits in the loser tree, so keys that parse the record are cheap
+// to use. Each input is read through its own read-ahead buffer and the output is batched. Records
+// with equal keys keep the order of their inputs. Returns false on a read, write or allocation
+// failure.
+template <typename Key>
+bool merge_sorted(cfile *inputs, std::size_t count, cfile &out, Key key,
+                  merge_options options = merge_options{}) {
+
+	using key_type = std::decay_t<decltype(key(std::declval<buffer_view>()))>;
+
+	std::vector<detail::record_cursor> cursors;
+	std::vector<key_type> keys(count);
+	std::vector<bool> exhausted(count);
+
+	cursors.reserve(count);
+
+	for (std::size_t i = 0; i < count; ++i) {
+
+		cursors.emplace_back(inputs[i], options.record_size, options.read_ahead);
+		exhausted[i] = !cursors[i].next();
+
+		if (!exhausted[i]) {
+			keys[i] = key(cursors[i].current());
+		}
+	}
+
+	auto compare = [&keys](std::size_t a, std::size_t b) { return keys[a] < keys[b]; };
+
+	detail::record_output output{out, options.record_size == 0, options.write_buffer};
+	loser_tree<decltype(compare)> tree{compare};
+	tree.build(count, exhausted);
+
+	while (!tree.empty()) {
+
+		std::size_t top = tree.top();
+		detail::record_cursor &cursor = cursors[top];
+
+		output.write(cursor.current());
+
+		if (cursor.next()) {
+			keys[top] = key(cursor.current());
+			tree.replay();
+		}
+		else {
+			tree.exhaust();
+		}
+	}
+
+	bool result = output.flush();
+
+	for (detail::record_cursor &cursor : cursors) {
+		result = result && !cursor.error();
+	}
+
+	return result;
+}
+
+template <typename Key>
+bool merge_sorted(std::vector<cfile> &inputs, cfile &out, Key key,
+                  merge_options options = merge_options{}) {
+	return merge_sorted(inputs.data(), inputs.size(), out, key, options);
+}
+
+} // namespace xtr
+
+
+#endif // MERGE_HPP
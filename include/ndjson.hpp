@@ -0,0 +1,228 @@
+#pragma once
+#ifndef NDJSON_HPP
+#define NDJSON_HPP
+
+
+#include "buffer_view.hpp"
+#include "byte_scan.hpp"
+#include "cfile.hpp"
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Owned run of complete newline-delimited records. Batches own their memory, so they can be moved
+// to worker threads and parsed there while the splitter reads on.
+class ndjson_batch {
+private:
+	std::unique_ptr<char[]> m_data;
+	std::vector<std::size_t> m_ends;
+	std::size_t m_size;
+
+	friend class ndjson_splitter;
+
+public:
+	ndjson_batch() noexcept : m_size{0} {}
+
+	[[nodiscard]] buffer_view view() const noexcept {
+		return buffer_view{m_data.get(), m_size};
+	}
+
+	[[nodiscard]] std::size_t size() const noexcept {
+		return m_size;
+	}
+
+	// Number of records, counting blank lines
+	[[nodiscard]] std::size_t records() const noexcept {
+		return m_ends.size();
+	}
+
+	// Calls function with a view of every non-blank record, without its line terminator
+	template <typename Function>
+	void for_each(Function function) const {
+
+		std::size_t start = 0;
+
+		for (std::size_t end : m_ends) {
+
+			std::size_t length = end - start;
+
+			if (length != 0 && m_data[start + length - 1] == '\r') {
+				--length;
+			}
+
+			if (length != 0) {
+				function(buffer_view{m_data.get() + start, length});
+			}
+
+			start = end + 1;
+		}
+	}
+};
+
+// Cuts newline-delimited JSON into batches of whole records of roughly batch_size bytes. Input is
+// classified 64 bytes at a time: backslash runs are resolved to find escaped characters, the
+// remaining quotes are turned into a string mask with a prefix XOR, and only newlines outside
+// strings end a record. The cfile is not owned and must outlive the splitter.
+class ndjson_splitter {
+private:
+	cfile *m_file;
+	std::unique_ptr<char[]> m_carry;
+	std::size_t m_carry_size;
+	std::size_t m_batch_size;
+	std::uint64_t m_escaped;
+	bool m_in_string;
+	bool m_error;
+
+	// Bit i is set for every character escaped by a backslash, carrying odd backslash runs over
+	// block boundaries in m_escaped
+	std::uint64_t escaped_mask(std::uint64_t backslashes, std::uint64_t &escapes) noexcept {
+
+		constexpr std::uint64_t odd_bits = 0xAAAAAAAAAAAAAAAAull;
+
+		if (backslashes == 0) {
+			escapes = 0;
+			return std::exchange(m_escaped, 0);
+		}
+
+		std::uint64_t potential = backslashes & ~m_escaped;
+		std::uint64_t codes = (((potential << 1) | odd_bits) - potential) ^ odd_bits;
+		std::uint64_t result = codes ^ (backslashes | m_escaped);
+
+		escapes = codes & backslashes;
+
+		return result;
+	}
+
+	// Appends record ends to ends and leaves the string and escape state after the last of the
+	// size valid bytes
+	void scan_block(const char *block, std::size_t base, std::size_t size,
+	                std::vector<std::size_t> &ends) noexcept {
+
+		std::uint64_t valid = size == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << size) - 1;
+		std::uint64_t escapes;
+		std::uint64_t escaped = escaped_mask(detail::equal_mask(block, '\\') & valid, escapes);
+		std::uint64_t quotes = detail::equal_mask(block, '"') & ~escaped & valid;
+		std::uint64_t inside = detail::prefix_xor(quotes) ^ (m_in_string ? ~std::uint64_t{0} : 0);
+		std::uint64_t newlines = detail::equal_mask(block, '\n') & ~inside & valid;
+
+		m_in_string = ((inside >> (size - 1)) & 1) != 0;
+		m_escaped = (escapes >> (size - 1)) & 1;
+
+		while (newlines != 0) {
+			ends.push_back(base + detail::trailing_zeros(newlines));
+			newlines &= newlines - 1;
+		}
+	}
+
+	void scan(const char *data, std::size_t begin, std::size_t end,
+	          std::vector<std::size_t> &ends) noexcept {
+
+		for (; end - begin >= detail::scan_block_size; begin += detail::scan_block_size) {
+			scan_block(data + begin, begin, detail::scan_block_size, ends);
+		}
+
+		if (begin != end) {
+
+			char block[detail::scan_block_size] = {};
+
+			std::memcpy(block, data + begin, end - begin);
+			scan_block(block, begin, end - begin, ends);
+		}
+	}
+
+public:
+	static constexpr std::size_t default_batch_size = 1024 * 1024;
+
+	explicit ndjson_splitter(cfile &file, std::size_t batch_size = default_batch_size) noexcept :
+	    m_file{&file}, m_carry_size{0}, m_batch_size{batch_size != 0 ? batch_size : 1},
+	    m_escaped{0}, m_in_string{false}, m_error{false} {}
+
+	// Fills batch with the next run of complete records, growing past batch_size only for a
+	// record that does not fit. A final record without a newline is returned as is. Returns false
+	// at end of input or if memory runs out.
+	bool next(ndjson_batch &batch) noexcept {
+
+		std::size_t capacity = m_batch_size > m_carry_size ? m_batch_size : 2 * m_carry_size;
+		std::unique_ptr<char[]> data{new (std::nothrow) char[capacity]};
+
+		if (data == nullptr) {
+			m_error = true;
+			return false;
+		}
+
+		std::size_t size = m_carry_size;
+
+		if (size != 0) {
+			std::memcpy(data.get(), m_carry.get(), size);
+		}
+
+		batch.m_ends.clear();
+
+		for (;;) {
+
+			std::size_t read = m_file->fread(data.get() + size, 1, capacity - size);
+
+			scan(data.get(), size, size + read, batch.m_ends);
+			size += read;
+
+			if (!batch.m_ends.empty() || size < capacity) {
+				break;
+			}
+
+			std::unique_ptr<char[]> grown{new (std::nothrow) char[2 * capacity]};
+
+			if (grown == nullptr) {
+				m_error = true;
+				return false;
+			}
+
+			std::memcpy(grown.get(), data.get(), size);
+			data = std::move(grown);
+			capacity *= 2;
+		}
+
+		std::size_t used = batch.m_ends.empty() ? size : batch.m_ends.back() + 1;
+
+		if (used == size && batch.m_ends.empty() && size != 0) {
+			batch.m_ends.push_back(size);
+		}
+
+		m_carry_size = size - used;
+
+		if (m_carry_size != 0) {
+
+			m_carry.reset(new (std::nothrow) char[m_carry_size]);
+
+			if (m_carry == nullptr) {
+				m_error = true;
+				return false;
+			}
+
+			std::memcpy(m_carry.get(), data.get() + used, m_carry_size);
+		}
+
+		batch.m_data = std::move(data);
+		batch.m_size = used;
+
+		return used != 0;
+	}
+
+	[[nodiscard]] bool error() noexcept {
+		return m_error || m_file->ferror() != 0;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // NDJSON_HPP
@@ -0,0 +1,412 @@
+#pragma once
+#ifndef NPY_HPP
+#define NPY_HPP
+
+
+#include "cfile.hpp"
+
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// NumPy .npy files: a short text header describing dtype, memory order and shape, followed by the
+// raw array payload, which is read and written with a single fread/fwrite
+namespace npy {
+
+constexpr std::size_t max_dimensions = 32;
+
+struct header {
+	// Array-protocol type string such as "<f8"
+	char descr[8];
+	bool fortran_order;
+	std::size_t ndim;
+	std::size_t shape[max_dimensions];
+
+	// Number of elements, or zero if the product overflows; read_header rejects such shapes
+	[[nodiscard]] std::size_t size() const noexcept {
+
+		std::size_t result = 1;
+
+		for (std::size_t i = 0; i < ndim; ++i) {
+
+			if (shape[i] == 0) {
+				return 0;
+			}
+		}
+
+		for (std::size_t i = 0; i < ndim; ++i) {
+
+			if (result > SIZE_MAX / shape[i]) {
+				return 0;
+			}
+
+			result *= shape[i];
+		}
+
+		return result;
+	}
+
+	[[nodiscard]] std::size_t item_size() const noexcept {
+
+		std::size_t result = 0;
+
+		for (const char *digit = descr + 2; *digit >= '0' && *digit <= '9'; ++digit) {
+			result = result * 10 + static_cast<std::size_t>(*digit - '0');
+		}
+
+		return result;
+	}
+
+	// True if the payload can be loaded into an array of Type, in either byte order
+	template <typename Type>
+	[[nodiscard]] bool holds() const noexcept;
+};
+
+namespace detail {
+
+template <typename Type>
+constexpr char kind() noexcept {
+	return std::is_same<Type, bool>::value          ? 'b'
+	       : std::is_floating_point<Type>::value ? 'f'
+	       : std::is_signed<Type>::value         ? 'i'
+	                                             : 'u';
+}
+
+constexpr char native_order = xtr::detail::native_little_endian ? '<' : '>';
+
+inline bool skip_spaces(const char *&input, const char *end) noexcept {
+
+	while (input != end && (*input == ' ' || *input == '\t' || *input == '\n')) {
+		++input;
+	}
+
+	return input != end;
+}
+
+inline bool expect(const char *&input, const char *end, const char *text) noexcept {
+
+	std::size_t length = std::strlen(text);
+
+	if (!skip_spaces(input, end) || static_cast<std::size_t>(end - input) < length
+	    || std::memcmp(input, text, length) != 0) {
+		return false;
+	}
+
+	input += length;
+
+	return true;
+}
+
+inline bool parse_string(const char *&input, const char *end, const char *&string,
+                         std::size_t &length) noexcept {
+
+	if (!skip_spaces(input, end) || (*input != '\'' && *input != '"')) {
+		return false;
+	}
+
+	char quote = *input++;
+	string = input;
+
+	while (input != end && *input != quote) {
+		++input;
+	}
+
+	if (input == end) {
+		return false;
+	}
+
+	length = static_cast<std::size_t>(input - string);
+	++input;
+
+	return true;
+}
+
+inline bool parse_shape(const char *&input, const char *end, header &result) noexcept {
+
+	if (!expect(input, end, "(")) {
+		return false;
+	}
+
+	result.ndim = 0;
+
+	while (skip_spaces(input, end) && *input != ')') {
+
+		if (*input < '0' || *input > '9' || result.ndim == max_dimensions) {
+			return false;
+		}
+
+		std::size_t value = 0;
+
+		while (input != end && *input >= '0' && *input <= '9') {
+
+			std::size_t digit = static_cast<std::size_t>(*input++ - '0');
+
+			if (value > (SIZE_MAX - digit) / 10) {
+				return false;
+			}
+
+			value = value * 10 + digit;
+		}
+
+		if (skip_spaces(input, end) && *input == 'L') {
+			++input;
+		}
+
+		result.shape[result.ndim++] = value;
+
+		if (skip_spaces(input, end) && *input == ',') {
+			++input;
+		}
+	}
+
+	return expect(input, end, ")");
+}
+
+inline bool parse_header(const char *input, const char *end, header &result) noexcept {
+
+	bool has_descr = false;
+	bool has_order = false;
+	bool has_shape = false;
+
+	if (!expect(input, end, "{")) {
+		return false;
+	}
+
+	while (skip_spaces(input, end) && *input != '}') {
+
+		const char *key;
+		std::size_t key_length;
+
+		if (!parse_string(input, end, key, key_length) || !expect(input, end, ":")) {
+			return false;
+		}
+
+		if (key_length == 5 && std::memcmp(key, "descr", 5) == 0) {
+
+			const char *value;
+			std::size_t value_length;
+
+			if (!parse_string(input, end, value, value_length)
+			    || value_length >= sizeof(result.descr) || value_length < 3) {
+				return false;
+			}
+
+			std::memcpy(result.descr, value, value_length);
+			result.descr[value_length] = '\0';
+			has_descr = true;
+		}
+		else if (key_length == 13 && std::memcmp(key, "fortran_order", 13) == 0) {
+
+			if (expect(input, end, "True")) {
+				result.fortran_order = true;
+			}
+			else if (expect(input, end, "False")) {
+				result.fortran_order = false;
+			}
+			else {
+				return false;
+			}
+
+			has_order = true;
+		}
+		else if (key_length == 5 && std::memcmp(key, "shape", 5) == 0) {
+
+			if (!parse_shape(input, end, result)) {
+				return false;
+			}
+
+			has_shape = true;
+		}
+		else {
+			return false;
+		}
+
+		if (skip_spaces(input, end) && *input == ',') {
+			++input;
+		}
+	}
+
+	return has_descr && has_order && has_shape && expect(input, end, "}");
+}
+
+} // namespace detail
+
+template <typename Type>
+bool header::holds() const noexcept {
+
+	static_assert(std::is_arithmetic<Type>::value, "type must be an arithmetic type");
+
+	return descr[1] == detail::kind<Type>() && item_size() == sizeof(Type)
+	       && (descr[0] == '<' || descr[0] == '>' || descr[0] == '|' || descr[0] == '=');
+}
+
+// Fills in the descr field for Type and the given shape
+template <typename Type>
+[[nodiscard]] header make_header(const std::size_t *shape, std::size_t ndim,
+                                 bool fortran_order = false) noexcept {
+
+	static_assert(std::is_arithmetic<Type>::value, "type must be an arithmetic type");
+	static_assert(sizeof(Type) < 10, "item size must be a single digit");
+
+	header result{};
+
+	result.descr[0] = sizeof(Type) == 1 ? '|' : detail::native_order;
+	result.descr[1] = detail::kind<Type>();
+	result.descr[2] = static_cast<char>('0' + sizeof(Type));
+	result.fortran_order = fortran_order;
+	result.ndim = ndim < max_dimensions ? ndim : max_dimensions;
+
+	for (std::size_t i = 0; i < result.ndim; ++i) {
+		result.shape[i] = shape[i];
+	}
+
+	return result;
+}
+
+// Writes format version 1.0, padding the header so that the payload starts on a 64-byte boundary
+inline bool write_header(cfile &file, const header &value) noexcept {
+
+	char text[128 + 24 * max_dimensions];
+
+	int length =
+	    std::snprintf(text, sizeof(text), "{'descr': '%s', 'fortran_order': %s, 'shape': (",
+	                  value.descr, value.fortran_order ? "True" : "False");
+
+	for (std::size_t i = 0; i < value.ndim; ++i) {
+
+		const char *separator = value.ndim == 1 ? "," : i + 1 != value.ndim ? ", " : "";
+
+		length += std::snprintf(text + length, sizeof(text) - static_cast<std::size_t>(length),
+		                        "%zu%s", value.shape[i], separator);
+	}
+
+	length += std::snprintf(text + length, sizeof(text) - static_cast<std::size_t>(length), "), }");
+
+	std::size_t size = static_cast<std::size_t>(length) + 1;
+	std::size_t padding = (64 - (10 + size) % 64) % 64;
+	std::size_t header_length = size + padding;
+
+	char magic[10] = {'\x93', 'N', 'U', 'M', 'P', 'Y', '\x01', '\x00'};
+	magic[8] = static_cast<char>(header_length & 0xFF);
+	magic[9] = static_cast<char>(header_length >> 8);
+
+	std::memset(text + length, ' ', padding);
+	text[header_length - 1] = '\n';
+
+	return file.fwrite(magic) == 10 && file.fwrite(text, 1, header_length) == header_length;
+}
+
+// Parses the header and leaves the cfile positioned at the start of the payload
+inline bool read_header(cfile &file, header &value) noexcept {
+
+	unsigned char magic[8];
+
+	if (file.fread(magic, 1, 8) != 8 || std::memcmp(magic, "\x93NUMPY", 6) != 0) {
+		return false;
+	}
+
+	std::size_t length = 0;
+
+	if (magic[6] == 1) {
+
+		std::uint16_t header_length;
+
+		if (file.read_le(header_length) != 1) {
+			return false;
+		}
+
+		length = header_length;
+	}
+	else if (magic[6] == 2 || magic[6] == 3) {
+
+		std::uint32_t header_length;
+
+		if (file.read_le(header_length) != 1 || header_length > 1024 * 1024) {
+			return false;
+		}
+
+		length = header_length;
+	}
+	else {
+		return false;
+	}
+
+	std::unique_ptr<char[]> text{new (std::nothrow) char[length]};
+
+	if (text == nullptr || file.fread(text.get(), 1, length) != length) {
+		return false;
+	}
+
+	value = header{};
+
+	if (!detail::parse_header(text.get(), text.get() + length, value)) {
+		return false;
+	}
+
+	// A shape whose element or byte count overflows is corrupt, not an empty array
+	std::size_t count = value.size();
+	std::size_t item_size = value.item_size();
+
+	for (std::size_t i = 0; i < value.ndim; ++i) {
+
+		if (value.shape[i] == 0) {
+			return true;
+		}
+	}
+
+	return count != 0 && (item_size == 0 || count <= SIZE_MAX / item_size);
+}
+
+// Writes the header and the payload of count elements in the given memory order
+template <typename Type>
+bool save(cfile &file, const Type *data, const std::size_t *shape, std::size_t ndim,
+          bool fortran_order = false) noexcept {
+
+	if (ndim > max_dimensions) {
+		return false;
+	}
+
+	header value = make_header<Type>(shape, ndim, fortran_order);
+	std::size_t count = value.size();
+
+	return write_header(file, value) && file.fwrite(data, count) == count;
+}
+
+// Reads the payload described by a header from read_header into data, which must hold
+// value.size() elements. Fails if the dtype does not match Type; payloads in the other byte
+// order are swapped in place.
+template <typename Type>
+bool load(cfile &file, const header &value, Type *data) noexcept {
+
+	if (!value.holds<Type>()) {
+		return false;
+	}
+
+	std::size_t count = value.size();
+
+	if (value.descr[0] == '<') {
+		return file.read_le(data, count) == count;
+	}
+
+	if (value.descr[0] == '>') {
+		return file.read_be(data, count) == count;
+	}
+
+	return file.fread(data, count) == count;
+}
+
+} // namespace npy
+
+} // namespace xtr
+
+
+#endif // NPY_HPP
@@ -0,0 +1,270 @@
+#pragma once
+#ifndef PLATFORM_HPP
+#define PLATFORM_HPP
+
+
+#include "cfile.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define XTR_POSIX 1
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Operating system services that <cstdio> does not cover, with plain stdio fallbacks where the
+// platform offers nothing better
+namespace platform {
+
+[[nodiscard]] inline int fileno(cfile &file) noexcept {
+#if defined(XTR_POSIX)
+	return ::fileno(file.get());
+#elif defined(_WIN32)
+	return ::_fileno(file.get());
+#else
+	(void)file;
+	return -1;
+#endif
+}
+
+// Reads from an absolute offset without moving the stream position, so several threads can read
+// the same file at once. Data still buffered for writing by stdio is not visible to it. Without
+// POSIX this seeks and reads, and the cfile must not be shared between threads.
+inline std::size_t pread(cfile &file, void *buffer, std::size_t size,
+                         std::uint64_t offset) noexcept {
+#if defined(XTR_POSIX)
+	int descriptor = fileno(file);
+	char *output = static_cast<char *>(buffer);
+	std::size_t result = 0;
+
+	while (result < size) {
+
+		ssize_t read = ::pread(descriptor, output + result, size - result,
+		                       static_cast<off_t>(offset + result));
+
+		if (read < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (read <= 0) {
+			break;
+		}
+
+		result += static_cast<std::size_t>(read);
+	}
+
+	return result;
+#else
+	if (offset > static_cast<std::uint64_t>(LONG_MAX)
+	    || file.fseek(static_cast<long>(offset), SEEK_SET) != 0) {
+		return 0;
+	}
+
+	return file.fread(buffer, 1, size);
+#endif
+}
+
+// Writes at an absolute offset without moving the stream position. Bypasses the stdio buffer, so
+// the cfile must not have buffered writes pending. Without POSIX this seeks and writes, and the
+// cfile must not be shared between threads.
+inline std::size_t pwrite(cfile &file, const void *buffer, std::size_t size,
+                          std::uint64_t offset) noexcept {
+#if defined(XTR_POSIX)
+	int descriptor = fileno(file);
+	const char *input = static_cast<const char *>(buffer);
+	std::size_t result = 0;
+
+	while (result < size) {
+
+		ssize_t written = ::pwrite(descriptor, input + result, size - result,
+		                           static_cast<off_t>(offset + result));
+
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (written <= 0) {
+			break;
+		}
+
+		result += static_cast<std::size_t>(written);
+	}
+
+	return result;
+#else
+	if (offset > static_cast<std::uint64_t>(LONG_MAX)
+	    || file.fseek(static_cast<long>(offset), SEEK_SET) != 0) {
+		return 0;
+	}
+
+	std::size_t result = file.fwrite(buffer, 1, size);
+	file.fflush();
+
+	return result;
+#endif
+}
+
+// Flushes stdio buffers and asks the operating system to put the file data on stable storage
+inline bool sync(cfile &file) noexcept {
+
+	if (file.fflush() != 0) {
+		return false;
+	}
+
+#if defined(__APPLE__)
+	return ::fsync(fileno(file)) == 0;
+#elif defined(XTR_POSIX)
+	return ::fdatasync(fileno(file)) == 0;
+#elif defined(_WIN32)
+	return ::_commit(fileno(file)) == 0;
+#else
+	return true;
+#endif
+}
+
+// Flushes stdio buffers and cuts the file to size bytes
+inline bool truncate(cfile &file, std::uint64_t size) noexcept {
+
+	if (file.fflush() != 0) {
+		return false;
+	}
+
+#if defined(XTR_POSIX)
+	return ::ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#elif defined(_WIN32)
+	return ::_chsize_s(fileno(file), static_cast<long long>(size)) == 0;
+#else
+	(void)size;
+	return false;
+#endif
+}
+
+// Size of the file in bytes, or zero if it cannot be determined. Data still buffered for writing
+// by stdio is not counted.
+[[nodiscard]] inline std::uint64_t file_size(cfile &file) noexcept {
+#if defined(XTR_POSIX)
+	struct stat status;
+
+	if (::fstat(fileno(file), &status) != 0 || status.st_size < 0) {
+		return 0;
+	}
+
+	return static_cast<std::uint64_t>(status.st_size);
+#else
+	long position = file.ftell();
+
+	if (position < 0 || file.fseek(0, SEEK_END) != 0) {
+		return 0;
+	}
+
+	long result = file.ftell();
+	file.fseek(position, SEEK_SET);
+
+	return result < 0 ? 0 : static_cast<std::uint64_t>(result);
+#endif
+}
+
+#if defined(XTR_POSIX)
+// Maps the first size bytes of the file shared between processes. Returns nullptr on failure.
+[[nodiscard]] inline void *map(cfile &file, std::size_t size, bool writable = true) noexcept {
+
+	void *result = ::mmap(nullptr, size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED,
+	                      fileno(file), 0);
+
+	return result == MAP_FAILED ? nullptr : result;
+}
+
+inline bool unmap(void *address, std::size_t size) noexcept {
+	return address == nullptr || ::munmap(address, size) == 0;
+}
+
+// Changes the size of a mapping made by map(), moving it if needed. Returns nullptr on failure, in
+// which case the old mapping is left in place.
+[[nodiscard]] inline void *remap(cfile &file, void *address, std::size_t size,
+                                 std::size_t new_size, bool writable = true) noexcept {
+#if defined(MREMAP_MAYMOVE)
+	(void)file;
+	(void)writable;
+
+	void *result = ::mremap(address, size, new_size, MREMAP_MAYMOVE);
+
+	return result == MAP_FAILED ? nullptr : result;
+#else
+	void *result = map(file, new_size, writable);
+
+	if (result != nullptr) {
+		unmap(address, size);
+	}
+
+	return result;
+#endif
+}
+
+// Takes an exclusive advisory lock on the whole file, waiting for other holders. The lock belongs
+// to the open file, so it excludes other processes and other cfiles on the same file, but not
+// other threads sharing this cfile. It is released by unlock() or when the file is closed,
+// including when the process dies.
+inline bool lock(cfile &file) noexcept {
+
+	int result;
+
+	do {
+		result = ::flock(fileno(file), LOCK_EX);
+	} while (result != 0 && errno == EINTR);
+
+	return result == 0;
+}
+
+inline bool unlock(cfile &file) noexcept {
+	return ::flock(fileno(file), LOCK_UN) == 0;
+}
+
+// Writes modified pages of a mapping back to the file, waiting for completion if wait is set
+inline bool sync_mapping(void *address, std::size_t size, bool wait = true) noexcept {
+	return ::msync(address, size, wait ? MS_SYNC : MS_ASYNC) == 0;
+}
+#endif
+
+// Thread-safe breakdown of a calendar time into local or UTC fields
+inline bool calendar_time(std::time_t time, std::tm &result, bool utc = false) noexcept {
+#if defined(XTR_POSIX)
+	return (utc ? ::gmtime_r(&time, &result) : ::localtime_r(&time, &result)) != nullptr;
+#elif defined(_WIN32)
+	return (utc ? ::gmtime_s(&result, &time) : ::localtime_s(&result, &time)) == 0;
+#else
+	const std::tm *converted = utc ? std::gmtime(&time) : std::localtime(&time);
+
+	if (converted == nullptr) {
+		return false;
+	}
+
+	result = *converted;
+
+	return true;
+#endif
+}
+
+[[nodiscard]] inline bool exists(const char *filename) noexcept {
+	return cfile{filename, mode::read | mode::binary} != nullptr;
+}
+
+} // namespace platform
+
+} // namespace xtr
+
+
+#endif // PLATFORM_HPP
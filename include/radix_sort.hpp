@@ -0,0 +1,309 @@
+#pragma once
+#ifndef RADIX_SORT_HPP
+#define RADIX_SORT_HPP
+
+
+#include "buffer_view.hpp"
+#include "cfile.hpp"
+#include "merge.hpp"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+struct radix_sort_options {
+	// Sorting threads; zero uses one per hardware thread
+	std::size_t threads = 0;
+	// Read-ahead buffer of each run when merging spilled runs, capped by the memory budget
+	std::size_t read_ahead = 1024 * 1024;
+};
+
+namespace detail {
+
+// Maps a key to an unsigned value with the same order
+template <typename Key>
+[[nodiscard]] std::make_unsigned_t<Key> radix_bits(Key key) noexcept {
+
+	using bits = std::make_unsigned_t<Key>;
+
+	bits value = static_cast<bits>(key);
+
+	if (std::is_signed<Key>::value) {
+		value ^= bits{1} << (8 * sizeof(Key) - 1);
+	}
+
+	return value;
+}
+
+// Runs fn(0) to fn(threads - 1), the first on the calling thread. Slices whose thread cannot be
+// started also run on the calling thread, so that started workers are always joined.
+template <typename Function>
+void run_parallel(std::size_t threads, Function &fn) {
+
+	std::vector<std::thread> workers;
+	std::size_t started = 1;
+
+	workers.reserve(threads - 1);
+
+	try {
+		for (; started < threads; ++started) {
+			std::size_t t = started;
+			workers.emplace_back([&fn, t] { fn(t); });
+		}
+	}
+	catch (const std::system_error &) {
+	}
+	catch (const std::bad_alloc &) {
+	}
+
+	for (std::size_t t = started; t < threads; ++t) {
+		fn(t);
+	}
+
+	fn(0);
+
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+// Stable LSD radix sort of data, one byte of the key per pass, using scratch of the same size.
+// Each thread takes a contiguous slice: it counts the digits in its slice, the counts are turned
+// into per-thread bucket offsets ordered by thread, and it scatters its slice to those offsets.
+// Passes whose digit is the same for every record are skipped. Returns data or scratch, whichever
+// holds the result.
+template <typename Type, typename Key>
+Type *radix_sort(Type *data, Type *scratch, std::size_t count, Key &key, std::size_t threads) {
+
+	using key_type = std::decay_t<decltype(key(*data))>;
+	using counts = std::array<std::size_t, 256>;
+
+	// Small slices are not worth a thread
+	threads = std::max<std::size_t>(std::min(threads, count / 65536), 1);
+
+	std::size_t slice = (count + threads - 1) / threads;
+	std::vector<counts> histograms(threads);
+
+	for (std::size_t digit = 0; digit < sizeof(key_type); ++digit) {
+
+		unsigned shift = static_cast<unsigned>(8 * digit);
+
+		auto count_slice = [&](std::size_t t) {
+
+			counts &histogram = histograms[t];
+			std::size_t end = std::min(count, (t + 1) * slice);
+
+			histogram.fill(0);
+
+			for (std::size_t i = t * slice; i < end; ++i) {
+				++histogram[(radix_bits(key(data[i])) >> shift) & 0xff];
+			}
+		};
+
+		run_parallel(threads, count_slice);
+
+		// Turn counts into offsets, bucket by bucket and thread by thread
+		std::size_t offset = 0;
+		bool uniform = false;
+
+		for (std::size_t bucket = 0; bucket < 256; ++bucket) {
+
+			std::size_t start = offset;
+
+			for (counts &histogram : histograms) {
+				std::size_t size = histogram[bucket];
+				histogram[bucket] = offset;
+				offset += size;
+			}
+
+			if (offset - start == count) {
+				uniform = true;
+				break;
+			}
+		}
+
+		if (uniform) {
+			continue;
+		}
+
+		auto scatter_slice = [&](std::size_t t) {
+
+			counts &offsets = histograms[t];
+			std::size_t end = std::min(count, (t + 1) * slice);
+
+			for (std::size_t i = t * slice; i < end; ++i) {
+				scratch[offsets[(radix_bits(key(data[i])) >> shift) & 0xff]++] = data[i];
+			}
+		};
+
+		run_parallel(threads, scatter_slice);
+
+		std::swap(data, scratch);
+	}
+
+	return data;
+}
+
+} // namespace detail
+
+// Sorts count trivially copyable records by an integral key with a parallel LSD radix sort. key
+// maps a record to its key, which may be signed. The sort is stable and takes one counting and one
+// scattering pass per key byte that differs between records, instead of log2(count) comparisons
+// per record. Returns false if the scratch buffer, the size of the data, or the per-thread counts
+// cannot be allocated.
+template <typename Type, typename Key>
+bool radix_sort(Type *data, std::size_t count, Key key, std::size_t threads = 0) {
+
+	static_assert(std::is_trivially_copyable<Type>::value,
+	              "radix sorted records must be trivially copyable");
+	static_assert(std::is_integral<std::decay_t<decltype(key(*data))>>::value,
+	              "radix sort keys must be integral");
+
+	std::unique_ptr<Type[]> scratch{new (std::nothrow) Type[count]};
+
+	if (scratch == nullptr) {
+		return false;
+	}
+
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	Type *sorted;
+
+	try {
+		sorted = detail::radix_sort(data, scratch.get(), count, key, threads);
+	}
+	catch (const std::bad_alloc &) {
+		return false;
+	}
+
+	if (sorted != data) {
+		std::copy(sorted, sorted + count, data);
+	}
+
+	return true;
+}
+
+namespace detail {
+
+// The body of radix_sort on files, where running out of memory throws std::bad_alloc
+template <typename Type, typename Key>
+bool radix_sort_file(cfile &in, cfile &out, Key &key, std::size_t memory_budget,
+                     const radix_sort_options &options) {
+
+	std::size_t threads = options.threads != 0 ? options.threads
+	                                           : std::max(1u, std::thread::hardware_concurrency());
+	std::size_t capacity = std::max<std::size_t>(memory_budget / (2 * sizeof(Type)), 1);
+	std::unique_ptr<Type[]> data{new (std::nothrow) Type[capacity]};
+	std::unique_ptr<Type[]> scratch{new (std::nothrow) Type[capacity]};
+	std::vector<cfile> runs;
+
+	if (data == nullptr || scratch == nullptr) {
+		return false;
+	}
+
+	for (;;) {
+
+		// Read bytes rather than records, so that a partial record at the end is seen
+		std::size_t bytes = in.fread(data.get(), 1, capacity * sizeof(Type));
+		std::size_t count = bytes / sizeof(Type);
+
+		if (in.ferror() != 0 || bytes % sizeof(Type) != 0) {
+			return false;
+		}
+
+		if (count == 0) {
+			break;
+		}
+
+		Type *sorted = detail::radix_sort(data.get(), scratch.get(), count, key, threads);
+
+		if (count < capacity && runs.empty()) {
+
+			// Everything fit in one chunk
+			return out.fwrite(sorted, sizeof(Type), count) == count;
+		}
+
+		runs.push_back(cfile::tmpfile());
+
+		cfile &run = runs.back();
+
+		if (run == nullptr || run.fwrite(sorted, sizeof(Type), count) != count
+		    || run.fflush() != 0) {
+			return false;
+		}
+
+		run.rewind();
+
+		if (count < capacity) {
+			break;
+		}
+	}
+
+	if (runs.empty()) {
+		return true;
+	}
+
+	data.reset();
+	scratch.reset();
+
+	merge_options merging;
+	merging.record_size = sizeof(Type);
+	merging.read_ahead = std::max<std::size_t>(
+	    std::min(options.read_ahead, memory_budget / (runs.size() + 1)), 4096);
+	merging.write_buffer = merging.read_ahead;
+
+	auto record_key = [&key](buffer_view record) {
+
+		Type value;
+		std::memcpy(&value, record.data(), sizeof(Type));
+
+		return key(value);
+	};
+
+	return merge_sorted(runs, out, record_key, merging);
+}
+
+} // namespace detail
+
+// Sorts a file of trivially copyable records by an integral key into out. The records are read
+// with bulk freads in chunks of memory_budget / 2 bytes, the other half being the radix sort
+// scratch buffer. Input that fits in one chunk is sorted in memory and written to out; otherwise
+// each chunk is spilled as a sorted run to a temporary file and the runs are merged with a loser
+// tree. Records are in native byte order, as written by fwrite. Returns false on a read, write or
+// allocation failure, or if the input ends partway through a record.
+template <typename Type, typename Key>
+bool radix_sort(cfile &in, cfile &out, Key key, std::size_t memory_budget = 256 * 1024 * 1024,
+                radix_sort_options options = radix_sort_options{}) {
+
+	static_assert(std::is_trivially_copyable<Type>::value,
+	              "radix sorted records must be trivially copyable");
+	static_assert(std::is_integral<std::decay_t<decltype(key(std::declval<Type &>()))>>::value,
+	              "radix sort keys must be integral");
+
+	try {
+		return detail::radix_sort_file<Type>(in, out, key, memory_budget, options);
+	}
+	catch (const std::bad_alloc &) {
+		return false;
+	}
+}
+
+} // namespace xtr
+
+
+#endif // RADIX_SORT_HPP
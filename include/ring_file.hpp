@@ -0,0 +1,317 @@
+#pragma once
+#ifndef RING_FILE_HPP
+#define RING_FILE_HPP
+
+
+#include "buffer_view.hpp"
+#include "cfile.hpp"
+#include "crc32.hpp"
+#include "platform.hpp"
+
+#include <mutex>
+#include <string>
+
+#include <cstddef>
+#include <cstdint>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Preallocated file of fixed capacity holding the most recent records, for always-on tracing with
+// bounded disk use. A 64-byte header holds a magic number, the capacity of the data area and the
+// head and tail as logical byte offsets that only grow; the data area is addressed modulo its
+// capacity, so records wrap around its end. Each record is framed as its size and a CRC-32 of its
+// bytes, both little-endian 32-bit integers, followed by the bytes.
+//
+// An append overwrites the oldest records when the ring is full: it first moves the head in the
+// header past them, then writes the record and then the new tail, all with positional writes, so
+// a crash at any point leaves a readable ring. Appends are thread-safe. The cfile should be opened
+// with mode::read | mode::binary | mode::extended, or mode::write | mode::binary | mode::extended
+// for a new ring; it is not owned and must outlive the ring.
+class ring_file {
+private:
+	cfile *m_file;
+	std::uint64_t m_capacity;
+	std::uint64_t m_head;
+	std::uint64_t m_tail;
+	std::mutex m_mutex;
+
+	static void store_u64(char *output, std::uint64_t value) noexcept {
+
+		for (std::size_t i = 0; i < 8; ++i) {
+			output[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+	[[nodiscard]] static std::uint64_t load_u64(const char *input) noexcept {
+
+		std::uint64_t result = 0;
+
+		for (std::size_t i = 0; i < 8; ++i) {
+			result |= static_cast<std::uint64_t>(static_cast<unsigned char>(input[i])) << (8 * i);
+		}
+
+		return result;
+	}
+
+	// Reads or writes size bytes at a logical offset, splitting the access where it wraps
+	template <typename Access>
+	bool access(std::uint64_t offset, std::size_t size, Access function) const noexcept {
+
+		std::uint64_t position = offset % m_capacity;
+		std::size_t first = m_capacity - position < size
+		                        ? static_cast<std::size_t>(m_capacity - position)
+		                        : size;
+
+		return function(header_size + position, 0, first)
+		       && (first == size || function(header_size, first, size - first));
+	}
+
+	bool read(std::uint64_t offset, void *buffer, std::size_t size) const noexcept {
+
+		char *output = static_cast<char *>(buffer);
+
+		auto part = [&](std::uint64_t position, std::size_t from, std::size_t count) {
+			return platform::pread(*m_file, output + from, count, position) == count;
+		};
+
+		return access(offset, size, part);
+	}
+
+	bool write(std::uint64_t offset, const void *buffer, std::size_t size) noexcept {
+
+		const char *input = static_cast<const char *>(buffer);
+
+		auto part = [&](std::uint64_t position, std::size_t from, std::size_t count) {
+			return platform::pwrite(*m_file, input + from, count, position) == count;
+		};
+
+		return access(offset, size, part);
+	}
+
+	bool write_header() noexcept {
+
+		char header[header_size] = {};
+
+		store_u64(header, magic);
+		store_u64(header + 8, m_capacity);
+		store_u64(header + 16, m_head);
+		store_u64(header + 24, m_tail);
+
+		return platform::pwrite(*m_file, header, header_size, 0) == header_size;
+	}
+
+	[[nodiscard]] static std::uint32_t load_u32(const char *input) noexcept {
+
+		std::uint32_t result = 0;
+
+		for (std::size_t i = 0; i < 4; ++i) {
+			result |= static_cast<std::uint32_t>(static_cast<unsigned char>(input[i])) << (8 * i);
+		}
+
+		return result;
+	}
+
+public:
+	static constexpr std::uint64_t magic = 0x31676e6972727478ull;
+	static constexpr std::size_t header_size = 64;
+	static constexpr std::size_t frame_header_size = 8;
+
+	ring_file() noexcept : m_file{nullptr}, m_capacity{0}, m_head{0}, m_tail{0} {}
+
+	ring_file(const ring_file &) = delete;
+
+	ring_file &operator=(const ring_file &) = delete;
+
+	// Opens the ring in file, or if the file is empty preallocates a ring of capacity bytes.
+	// Returns false if the file holds something else.
+	bool open(cfile &file, std::uint64_t capacity) noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		m_file = &file;
+
+		if (platform::file_size(file) == 0) {
+
+			m_capacity = capacity;
+			m_head = 0;
+			m_tail = 0;
+
+			return capacity > frame_header_size && platform::truncate(file, header_size + capacity)
+			       && write_header();
+		}
+
+		char header[header_size];
+
+		if (platform::pread(file, header, header_size, 0) != header_size
+		    || load_u64(header) != magic) {
+			m_file = nullptr;
+			return false;
+		}
+
+		m_capacity = load_u64(header + 8);
+		m_head = load_u64(header + 16);
+		m_tail = load_u64(header + 24);
+
+		if (m_capacity <= frame_header_size || m_head > m_tail || m_tail - m_head > m_capacity
+		    || platform::file_size(file) < header_size + m_capacity) {
+			m_file = nullptr;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Returns false if the record is larger than the ring or than 4 GiB - 1 bytes, the most its
+	// 32-bit size can hold, or if a write fails
+	bool append(buffer_view record) noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		std::uint64_t size = frame_header_size + std::uint64_t{record.size()};
+
+		if (m_file == nullptr || std::uint64_t{record.size()} > UINT32_MAX || size > m_capacity) {
+			return false;
+		}
+
+		std::uint64_t head = m_head;
+
+		while (m_tail + size - head > m_capacity) {
+
+			char frame[frame_header_size];
+
+			if (!read(head, frame, frame_header_size)) {
+				return false;
+			}
+
+			head += frame_header_size + load_u32(frame);
+		}
+
+		if (head != m_head) {
+
+			m_head = head > m_tail ? m_tail : head;
+
+			if (!write_header()) {
+				return false;
+			}
+		}
+
+		// The record goes straight from the caller's memory, after its header; neither is visible
+		// until the tail in the file header moves past them
+		char frame[frame_header_size];
+		std::uint32_t checksum = crc32(record.data(), record.size());
+
+		for (std::size_t i = 0; i < 4; ++i) {
+			frame[i] = static_cast<char>((record.size() >> (8 * i)) & 0xFF);
+			frame[4 + i] = static_cast<char>((checksum >> (8 * i)) & 0xFF);
+		}
+
+		if (!write(m_tail, frame, frame_header_size)
+		    || (!record.empty()
+		        && !write(m_tail + frame_header_size, record.data(), record.size()))) {
+			return false;
+		}
+
+		m_tail += size;
+
+		return write_header();
+	}
+
+	// Calls function with every record from the oldest to the newest, reading the data area in
+	// large sequential chunks. The header is read afresh, so this also works on a ring another
+	// process is writing; it stops at the first record that fails its checksum.
+	template <typename Function>
+	bool for_each(Function function, std::size_t chunk_size = 1024 * 1024) const {
+
+		char header[header_size];
+
+		if (m_file == nullptr
+		    || platform::pread(*m_file, header, header_size, 0) != header_size) {
+			return false;
+		}
+
+		std::uint64_t position = load_u64(header + 16);
+		std::uint64_t tail = load_u64(header + 24);
+		std::uint64_t loaded = position;
+		std::string buffer;
+		std::size_t begin = 0;
+
+		while (position < tail) {
+
+			std::size_t available = static_cast<std::size_t>(loaded - position);
+			std::size_t needed = frame_header_size;
+
+			if (available >= frame_header_size) {
+
+				const char *frame = buffer.data() + begin;
+				needed += load_u32(frame);
+
+				if (position + needed > tail) {
+					return false;
+				}
+
+				if (available >= needed) {
+
+					buffer_view record{frame + frame_header_size, needed - frame_header_size};
+
+					if (crc32(record.data(), record.size()) != load_u32(frame + 4)) {
+						return false;
+					}
+
+					function(record);
+					position += needed;
+					begin += needed;
+
+					continue;
+				}
+			}
+
+			// Keep the partial record and read the next chunk behind it
+			std::size_t count = static_cast<std::size_t>(
+			    tail - loaded < chunk_size ? tail - loaded : chunk_size);
+
+			if (needed - available > tail - loaded) {
+				return false;
+			}
+
+			count = count < needed - available ? needed - available : count;
+
+			buffer.erase(0, begin);
+			begin = 0;
+			buffer.resize(available + count);
+
+			if (!read(loaded, &buffer[available], count)) {
+				return false;
+			}
+
+			loaded += count;
+		}
+
+		return true;
+	}
+
+	[[nodiscard]] std::uint64_t capacity() const noexcept {
+		return m_capacity;
+	}
+
+	// Bytes of the data area holding records
+	[[nodiscard]] std::uint64_t used() noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		return m_tail - m_head;
+	}
+
+	bool sync() noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		return m_file != nullptr && platform::sync(*m_file);
+	}
+};
+
+} // namespace xtr
+
+
+#endif // RING_FILE_HPP
@@ -0,0 +1,284 @@
+#pragma once
+#ifndef ROTATING_WRITER_HPP
+#define ROTATING_WRITER_HPP
+
+
+#include "buffer_view.hpp"
+#include "cfile.hpp"
+#include "platform.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+
+// 'extra' namespace
+namespace xtr {
+
+struct rotating_writer_options {
+	// Rotate before a write would take the file past this many bytes; zero disables
+	std::uint64_t max_size = 0;
+	// Rotate on the first write after the file has been open this long; zero disables
+	std::chrono::seconds max_age{0};
+	// Called on the background thread with the name of every file retired by a rotation, once it
+	// is closed, for example to compress or upload it
+	std::function<void(const std::string &)> on_closed;
+};
+
+// Log writer that moves to a new file when the current one reaches a size or an age. Files are
+// named <base>.<sequence>, numbered upwards from the first free number, so a rotation renames
+// nothing. A background thread keeps the next file open in advance and closes retired files, so
+// rotating on the writing thread is just a pointer swap. Writes must come from one thread at a
+// time.
+class rotating_writer {
+public:
+	using options = rotating_writer_options;
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct open_file {
+		std::unique_ptr<cfile> file;
+		std::string name;
+	};
+
+	std::string m_base;
+	options m_options;
+	open_file m_current;
+	std::uint64_t m_size;
+	clock::time_point m_deadline;
+
+	// Shared with the background thread
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	open_file m_next;
+	std::deque<open_file> m_retired;
+	std::uint64_t m_sequence;
+	bool m_opening;
+	bool m_stop;
+	std::thread m_thread;
+
+	[[nodiscard]] std::string make_name(std::uint64_t sequence) const {
+
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), ".%06llu", static_cast<unsigned long long>(sequence));
+
+		return m_base + suffix;
+	}
+
+	// Opens the file with the next sequence number; called with the lock held, which it drops
+	// around fopen
+	[[nodiscard]] open_file open_next(std::unique_lock<std::mutex> &lock) {
+
+		std::string name = make_name(m_sequence++);
+
+		lock.unlock();
+
+		std::unique_ptr<cfile> file{new cfile{name.c_str(), mode::append | mode::binary}};
+
+		lock.lock();
+
+		if (*file == nullptr) {
+			file.reset();
+		}
+
+		return open_file{std::move(file), std::move(name)};
+	}
+
+	void run() {
+
+		std::unique_lock<std::mutex> lock{m_mutex};
+
+		for (;;) {
+
+			m_wake.wait(lock, [this] {
+				return m_stop || m_next.file == nullptr || !m_retired.empty();
+			});
+
+			while (!m_retired.empty()) {
+
+				open_file retired = std::move(m_retired.front());
+				m_retired.pop_front();
+
+				lock.unlock();
+
+				retired.file.reset();
+
+				if (m_options.on_closed) {
+					m_options.on_closed(retired.name);
+				}
+
+				lock.lock();
+			}
+
+			if (m_stop) {
+				break;
+			}
+
+			if (m_next.file == nullptr) {
+
+				m_opening = true;
+				open_file next = open_next(lock);
+				m_opening = false;
+
+				m_wake.notify_all();
+
+				// Retry on the next rotation rather than spinning on a failing fopen
+				if (next.file == nullptr) {
+					m_wake.wait(lock, [this] { return m_stop || !m_retired.empty(); });
+					continue;
+				}
+
+				m_next = std::move(next);
+			}
+		}
+	}
+
+	bool rotate() {
+
+		open_file next;
+
+		{
+			std::unique_lock<std::mutex> lock{m_mutex};
+
+			// A file being opened already has the next sequence number
+			m_wake.wait(lock, [this] { return !m_opening; });
+
+			next = std::move(m_next);
+
+			// The background thread has fallen behind; open inline instead of waiting for it
+			if (next.file == nullptr) {
+				next = open_next(lock);
+			}
+
+			if (next.file == nullptr) {
+				return false;
+			}
+
+			m_retired.push_back(std::move(m_current));
+		}
+
+		m_wake.notify_all();
+
+		m_current = std::move(next);
+		m_size = 0;
+		m_deadline = clock::now() + m_options.max_age;
+
+		return true;
+	}
+
+public:
+	rotating_writer() noexcept : m_size{0}, m_sequence{0}, m_opening{false}, m_stop{false} {}
+
+	rotating_writer(const rotating_writer &) = delete;
+
+	rotating_writer &operator=(const rotating_writer &) = delete;
+
+	~rotating_writer() {
+		close();
+	}
+
+	// Starts writing to the first unused file <base>.<sequence> and starts the background thread
+	bool open(const char *base, options settings = options{}) {
+
+		close();
+
+		m_base = base;
+		m_options = std::move(settings);
+		m_sequence = 1;
+
+		while (platform::exists(make_name(m_sequence).c_str())) {
+			++m_sequence;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock{m_mutex};
+
+			m_current = open_next(lock);
+			m_stop = false;
+		}
+
+		if (m_current.file == nullptr) {
+			return false;
+		}
+
+		m_size = 0;
+		m_deadline = clock::now() + m_options.max_age;
+		m_thread = std::thread{&rotating_writer::run, this};
+
+		return true;
+	}
+
+	// Writes the data to the current file, rotating first if it is full or too old. Data is never
+	// split across files.
+	bool write(const void *data, std::size_t size) {
+
+		if (m_current.file == nullptr) {
+			return false;
+		}
+
+		bool full = m_options.max_size != 0 && m_size != 0 && m_size + size > m_options.max_size;
+		bool old = m_options.max_age.count() != 0 && clock::now() >= m_deadline;
+
+		if ((full || old) && !rotate()) {
+			return false;
+		}
+
+		m_size += size;
+
+		return m_current.file->fwrite(data, 1, size) == size;
+	}
+
+	bool write(buffer_view data) {
+		return write(data.data(), data.size());
+	}
+
+	bool flush() noexcept {
+		return m_current.file != nullptr && m_current.file->fflush() == 0;
+	}
+
+	// Name of the file being written
+	[[nodiscard]] const std::string &filename() const noexcept {
+		return m_current.name;
+	}
+
+	// Stops the background thread after it has closed every retired file, closes the current file
+	// and removes the unused file opened in advance
+	void close() {
+
+		if (m_thread.joinable()) {
+
+			{
+				std::lock_guard<std::mutex> lock{m_mutex};
+				m_stop = true;
+			}
+
+			m_wake.notify_all();
+			m_thread.join();
+		}
+
+		m_current = open_file{};
+
+		if (m_next.file != nullptr) {
+			m_next.file.reset();
+			cfile::remove(m_next.name.c_str());
+		}
+
+		m_next = open_file{};
+	}
+};
+
+} // namespace xtr
+
+
+#endif // ROTATING_WRITER_HPP
@@ -0,0 +1,582 @@
+#pragma once
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+
+#include "buffer_view.hpp"
+#include "byte_scan.hpp"
+#include "cfile.hpp"
+#include "platform.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+
+// 'extra' namespace
+namespace xtr {
+
+struct search_options {
+	// Threads searching disjoint ranges of the file with pread; POSIX only, ignored elsewhere
+	std::size_t threads = 1;
+	// Bytes read at a time by each thread
+	std::size_t buffer_size = 1024 * 1024;
+};
+
+namespace detail {
+
+// Index of the first occurrence of pattern in data, or size if there is none. With SSE2, 16
+// candidate positions are tested at once by comparing the first and the last byte of the pattern
+// against two overlapping loads; only positions where both match are compared in full.
+[[nodiscard]] inline std::size_t find_substring(const char *data, std::size_t size,
+                                                const char *pattern, std::size_t length) noexcept {
+
+	assert(length != 0);
+
+	if (length > size) {
+		return size;
+	}
+
+	std::size_t last_start = size - length;
+	std::size_t middle = length > 2 ? length - 2 : 0;
+	std::size_t i = 0;
+
+#if defined(XTR_SSE2)
+	__m128i first = _mm_set1_epi8(pattern[0]);
+	__m128i last = _mm_set1_epi8(pattern[length - 1]);
+
+	for (; i + 16 <= last_start + 1; i += 16) {
+
+		__m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		__m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + length - 1));
+		unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(
+		    _mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last))));
+
+		for (; bits != 0; bits &= bits - 1) {
+
+			std::size_t candidate = i + trailing_zeros(bits);
+
+			if (std::memcmp(data + candidate + 1, pattern + 1, middle) == 0) {
+				return candidate;
+			}
+		}
+	}
+
+	for (; i <= last_start; ++i) {
+
+		if (data[i] == pattern[0] && data[i + length - 1] == pattern[length - 1]
+		    && std::memcmp(data + i + 1, pattern + 1, middle) == 0) {
+			return i;
+		}
+	}
+
+	return size;
+#else
+	while (i <= last_start) {
+
+		const void *candidate = std::memchr(data + i, pattern[0], last_start + 1 - i);
+
+		if (candidate == nullptr) {
+			return size;
+		}
+
+		i = static_cast<std::size_t>(static_cast<const char *>(candidate) - data);
+
+		if (data[i + length - 1] == pattern[length - 1]
+		    && std::memcmp(data + i + 1, pattern + 1, middle) == 0) {
+			return i;
+		}
+
+		++i;
+	}
+
+	return size;
+#endif
+}
+
+// Matcher for a single pattern, with the interface scan_blocks expects
+class substring_matcher {
+private:
+	buffer_view m_pattern;
+
+public:
+	explicit substring_matcher(buffer_view pattern) noexcept : m_pattern{pattern} {
+		assert(!pattern.empty());
+	}
+
+	[[nodiscard]] std::size_t longest() const noexcept {
+		return m_pattern.size();
+	}
+
+	// Calls fn(start, end, 0) for every occurrence, overlapping ones included
+	template <typename Function>
+	void scan(const char *data, std::size_t size, Function &fn) const {
+
+		for (std::size_t i = 0; i < size;) {
+
+			std::size_t found =
+			    i + find_substring(data + i, size - i, m_pattern.data(), m_pattern.size());
+
+			if (found == size) {
+				break;
+			}
+
+			fn(found, found + m_pattern.size(), std::size_t{0});
+			i = found + 1;
+		}
+	}
+};
+
+// Feeds the bytes from first - lead to last, as returned by read(buffer, size, offset), through
+// the matcher in blocks of buffer_size. The last longest - 1 bytes of each block are scanned again
+// with the next so that matches across the boundary are found; only matches ending after the
+// bytes already searched, and after first, are passed on as fn(offset, pattern). A range ending
+// at first therefore belongs to the previous range, which lets threads split a file.
+template <typename Matcher, typename Read, typename Function>
+bool scan_blocks(const Matcher &matcher, Read &read, std::uint64_t first, std::uint64_t last,
+                 std::size_t lead, std::size_t buffer_size, Function &fn) {
+
+	std::size_t overlap = matcher.longest() - 1;
+	std::unique_ptr<char[]> buffer{new (std::nothrow) char[overlap + buffer_size]};
+
+	if (buffer == nullptr) {
+		return false;
+	}
+
+	std::uint64_t position = first - lead;
+	std::uint64_t searched = first;
+	std::size_t kept = 0;
+
+	while (position < last) {
+
+		std::size_t count = read(buffer.get() + kept,
+		                         static_cast<std::size_t>(std::min<std::uint64_t>(
+		                             buffer_size, last - position)),
+		                         position);
+
+		if (count == 0) {
+			break;
+		}
+
+		std::uint64_t base = position - kept;
+		std::size_t size = kept + count;
+
+		auto report = [&](std::size_t start, std::size_t end, std::size_t pattern) {
+
+			if (base + end > searched) {
+				fn(base + start, pattern);
+			}
+		};
+
+		matcher.scan(buffer.get(), size, report);
+
+		position += count;
+		searched = position;
+		kept = std::min(overlap, size);
+
+		std::memmove(buffer.get(), buffer.get() + size - kept, kept);
+	}
+
+	return true;
+}
+
+// Searches in from its current position, reporting fn(offset, pattern) in order of the end of the
+// match with offsets counted from that position. Threads search the file in rounds of one range
+// each, and the matches of a round are reported before the next starts, so only one round of
+// matches is held at a time.
+template <typename Matcher, typename Function>
+bool search_file(const Matcher &matcher, cfile &in, Function &fn, const search_options &options) {
+
+	std::size_t buffer_size = std::max<std::size_t>(options.buffer_size, 4096);
+
+#if defined(XTR_POSIX)
+	long start = in.ftell();
+	std::uint64_t end = platform::file_size(in);
+
+	if (options.threads > 1 && start >= 0 && end > static_cast<std::uint64_t>(start)) {
+
+		using match = std::pair<std::uint64_t, std::size_t>;
+
+		// Blocks each thread searches per round
+		constexpr std::uint64_t range_blocks = 16;
+
+		std::uint64_t begin = static_cast<std::uint64_t>(start);
+		std::uint64_t total = end - begin;
+		std::uint64_t range = std::min<std::uint64_t>(range_blocks * buffer_size,
+		                                              total / options.threads + 1);
+		std::size_t threads = static_cast<std::size_t>(
+		    std::min<std::uint64_t>(options.threads, total / buffer_size + 1));
+		std::vector<std::vector<match>> found(threads);
+		std::atomic<bool> failed{false};
+
+		for (std::uint64_t round = begin; round < end && !failed; round += threads * range) {
+
+			std::vector<std::thread> workers;
+
+			for (std::size_t t = 0; t < threads && round + t * range < end; ++t) {
+
+				std::uint64_t first = round + t * range;
+				std::uint64_t last = std::min(first + range, end);
+				std::size_t lead = static_cast<std::size_t>(
+				    std::min<std::uint64_t>(matcher.longest() - 1, first - begin));
+
+				workers.emplace_back([&, t, first, last, lead] {
+
+					auto read = [&](char *buffer, std::size_t size, std::uint64_t offset) {
+
+						std::size_t result = platform::pread(in, buffer, size, offset);
+
+						if (result < size) {
+							failed = true;
+						}
+
+						return result;
+					};
+
+					// An exception must not escape the thread
+					auto collect = [&](std::uint64_t offset, std::size_t pattern) {
+
+						try {
+							found[t].emplace_back(offset - begin, pattern);
+						}
+						catch (const std::bad_alloc &) {
+							failed = true;
+						}
+					};
+
+					if (!scan_blocks(matcher, read, first, last, lead, buffer_size, collect)) {
+						failed = true;
+					}
+				});
+			}
+
+			for (std::thread &worker : workers) {
+				worker.join();
+			}
+
+			if (failed) {
+				break;
+			}
+
+			for (std::vector<match> &matches : found) {
+
+				for (const match &item : matches) {
+					fn(item.first, item.second);
+				}
+
+				matches.clear();
+			}
+		}
+
+		in.fseek(0, SEEK_END);
+
+		return !failed;
+	}
+#endif
+
+	auto read = [&in](char *buffer, std::size_t size, std::uint64_t) {
+		return in.fread(buffer, 1, size);
+	};
+
+	return scan_blocks(matcher, read, 0, UINT64_MAX, 0, buffer_size, fn) && in.ferror() == 0;
+}
+
+} // namespace detail
+
+// Index of the first occurrence of pattern in text, or text.size() if there is none; a vectorized
+// replacement for strstr that does not stop at null bytes. The pattern must not be empty.
+[[nodiscard]] inline std::size_t find(buffer_view text, buffer_view pattern) noexcept {
+	return detail::find_substring(text.data(), text.size(), pattern.data(), pattern.size());
+}
+
+// Streams through the file from its current position in large blocks and calls fn(offset) for
+// every occurrence of pattern, overlapping ones included, in order. Offsets count from the
+// starting position. With options.threads above one on POSIX, threads search ranges of the file
+// with pread and matches are handed to fn on the calling thread after each round of ranges; data
+// still buffered for writing by stdio must be flushed first. Returns false on a read or allocation
+// failure.
+template <typename Function>
+bool search(cfile &in, buffer_view pattern, Function fn,
+            search_options options = search_options{}) {
+
+	detail::substring_matcher matcher{pattern};
+
+	auto report = [&fn](std::uint64_t offset, std::size_t) { fn(offset); };
+
+	return detail::search_file(matcher, in, report, options);
+}
+
+// Aho-Corasick automaton finding any number of patterns in one pass. The trie is turned into a
+// full transition table over byte classes, the distinct bytes of the patterns plus one class for
+// every other byte, so each input byte costs two table lookups and no failure-link chasing; it
+// takes 4 bytes per state and class. While no pattern is partly matched, the scan skips ahead to
+// the next byte that starts a pattern: with SSE2 compares when there are at most four such bytes,
+// and otherwise with SSSE3 by looking up the two nibbles of 16 bytes at once in a bitmap of them.
+class multi_searcher {
+private:
+	std::vector<std::uint32_t> m_next;
+	std::vector<std::uint32_t> m_terminal;
+	std::vector<std::uint32_t> m_suffix;
+	std::vector<std::uint8_t> m_reports;
+	std::vector<std::uint32_t> m_same;
+	std::vector<std::size_t> m_lengths;
+	std::array<std::uint16_t, 256> m_class;
+	std::array<bool, 256> m_start;
+	// Bit h of entry l is set if the byte with high nibble h, less 8 in the second table, and low
+	// nibble l starts a pattern
+	std::array<std::uint8_t, 16> m_start_low;
+	std::array<std::uint8_t, 16> m_start_high;
+	char m_start_bytes[4];
+	std::size_t m_start_count;
+	std::size_t m_classes;
+	std::size_t m_longest;
+
+	[[nodiscard]] std::size_t skip(const char *data, std::size_t i, std::size_t size) const {
+
+		if (m_start_count <= 4) {
+			return i + detail::find_first_of(data + i, size - i, m_start_bytes[0],
+			                                 m_start_bytes[1], m_start_bytes[2], m_start_bytes[3]);
+		}
+
+#if defined(__SSSE3__)
+		alignas(16) static const std::uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+		                                                  1, 2, 4, 8, 16, 32, 64, 128};
+
+		__m128i low_table = _mm_loadu_si128(reinterpret_cast<const __m128i *>(m_start_low.data()));
+		__m128i high_table =
+		    _mm_loadu_si128(reinterpret_cast<const __m128i *>(m_start_high.data()));
+		__m128i bit_table = _mm_load_si128(reinterpret_cast<const __m128i *>(bits));
+		__m128i nibble = _mm_set1_epi8(0x0F);
+
+		for (; i + 16 <= size; i += 16) {
+
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+			__m128i low = _mm_and_si128(bytes, nibble);
+			__m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+			__m128i upper = _mm_cmpgt_epi8(high, _mm_set1_epi8(7));
+			__m128i rows = _mm_or_si128(_mm_and_si128(upper, _mm_shuffle_epi8(high_table, low)),
+			                            _mm_andnot_si128(upper, _mm_shuffle_epi8(low_table, low)));
+			__m128i misses = _mm_cmpeq_epi8(
+			    _mm_and_si128(rows, _mm_shuffle_epi8(bit_table, high)), _mm_setzero_si128());
+			unsigned found = static_cast<unsigned>(_mm_movemask_epi8(misses)) ^ 0xFFFF;
+
+			if (found != 0) {
+				return i + detail::trailing_zeros(found);
+			}
+		}
+#endif
+
+		while (i < size && !m_start[static_cast<unsigned char>(data[i])]) {
+			++i;
+		}
+
+		return i;
+	}
+
+public:
+	// Patterns must not be empty; identical patterns are each reported
+	explicit multi_searcher(const std::vector<std::string> &patterns) :
+	    m_start_count{0}, m_classes{1}, m_longest{0} {
+
+		assert(!patterns.empty());
+
+		m_class.fill(0);
+		m_start.fill(false);
+		m_start_low.fill(0);
+		m_start_high.fill(0);
+
+		for (const std::string &pattern : patterns) {
+
+			assert(!pattern.empty());
+
+			unsigned char first = static_cast<unsigned char>(pattern[0]);
+
+			if (!m_start[first]) {
+
+				m_start[first] = true;
+
+				std::uint8_t bit = static_cast<std::uint8_t>(1u << (first >> 4 & 7));
+				(first < 0x80 ? m_start_low : m_start_high)[first & 0x0F] |= bit;
+
+				if (m_start_count < 4) {
+					m_start_bytes[m_start_count] = pattern[0];
+				}
+
+				++m_start_count;
+			}
+
+			for (char byte : pattern) {
+
+				std::uint16_t &index = m_class[static_cast<unsigned char>(byte)];
+
+				if (index == 0) {
+					index = static_cast<std::uint16_t>(m_classes++);
+				}
+			}
+
+			m_longest = std::max(m_longest, pattern.size());
+		}
+
+		for (std::size_t i = m_start_count; i < 4; ++i) {
+			m_start_bytes[i] = m_start_bytes[0];
+		}
+
+		// Build the trie; a zero transition means no child, since no edge leads back to the root
+		m_next.assign(m_classes, 0);
+		m_terminal.assign(1, 0);
+		m_same.assign(patterns.size(), 0);
+		m_lengths.reserve(patterns.size());
+
+		for (std::size_t id = 0; id < patterns.size(); ++id) {
+
+			std::uint32_t state = 0;
+
+			for (char byte : patterns[id]) {
+
+				std::size_t index =
+				    state * m_classes + m_class[static_cast<unsigned char>(byte)];
+
+				if (m_next[index] == 0) {
+					m_next[index] = static_cast<std::uint32_t>(m_terminal.size());
+					m_terminal.push_back(0);
+					m_next.resize(m_terminal.size() * m_classes, 0);
+				}
+
+				state = m_next[index];
+			}
+
+			std::uint32_t head = m_terminal[state];
+
+			if (head == 0) {
+				m_terminal[state] = static_cast<std::uint32_t>(id + 1);
+			}
+			else {
+				m_same[id] = m_same[head - 1];
+				m_same[head - 1] = static_cast<std::uint32_t>(id + 1);
+			}
+
+			m_lengths.push_back(patterns[id].size());
+		}
+
+		// Breadth first, fill in missing transitions from the failure state, whose row is already
+		// complete, and link each state to its longest proper suffix that ends a pattern
+		std::size_t states = m_terminal.size();
+		std::vector<std::uint32_t> failure(states, 0);
+		std::vector<std::uint32_t> queue;
+
+		m_suffix.assign(states, 0);
+		queue.reserve(states);
+
+		for (std::size_t c = 0; c < m_classes; ++c) {
+
+			if (m_next[c] != 0) {
+				queue.push_back(m_next[c]);
+			}
+		}
+
+		for (std::size_t head = 0; head < queue.size(); ++head) {
+
+			std::uint32_t state = queue[head];
+
+			for (std::size_t c = 0; c < m_classes; ++c) {
+
+				std::uint32_t &child = m_next[state * m_classes + c];
+				std::uint32_t fallback = m_next[failure[state] * m_classes + c];
+
+				if (child == 0) {
+					child = fallback;
+					continue;
+				}
+
+				failure[child] = fallback;
+				m_suffix[child] = m_terminal[fallback] != 0 ? fallback : m_suffix[fallback];
+				queue.push_back(child);
+			}
+		}
+
+		m_reports.resize(states);
+
+		for (std::size_t state = 0; state < states; ++state) {
+			m_reports[state] = m_terminal[state] != 0 || m_suffix[state] != 0;
+		}
+	}
+
+	[[nodiscard]] std::size_t longest() const noexcept {
+		return m_longest;
+	}
+
+	[[nodiscard]] std::size_t states() const noexcept {
+		return m_terminal.size();
+	}
+
+	// Calls fn(start, end, pattern) for every match in data, in order of end
+	template <typename Function>
+	void scan(const char *data, std::size_t size, Function &fn) const {
+
+		std::uint32_t state = 0;
+
+		for (std::size_t i = 0; i < size;) {
+
+			if (state == 0) {
+
+				i = skip(data, i, size);
+
+				if (i == size) {
+					break;
+				}
+			}
+
+			state = m_next[state * m_classes + m_class[static_cast<unsigned char>(data[i++])]];
+
+			if (m_reports[state] == 0) {
+				continue;
+			}
+
+			for (std::uint32_t match = state; match != 0; match = m_suffix[match]) {
+
+				for (std::uint32_t id = m_terminal[match]; id != 0; id = m_same[id - 1]) {
+					fn(i - m_lengths[id - 1], i, std::size_t{id - 1});
+				}
+			}
+		}
+	}
+
+	// Calls fn(offset, pattern) for every match in text, in order of end
+	template <typename Function>
+	void search(buffer_view text, Function fn) const {
+
+		auto report = [&fn](std::size_t start, std::size_t, std::size_t pattern) {
+			fn(start, pattern);
+		};
+
+		scan(text.data(), text.size(), report);
+	}
+
+	// Streams through the file like xtr::search, calling fn(offset, pattern) for every match in
+	// order of end
+	template <typename Function>
+	bool search(cfile &in, Function fn, search_options options = search_options{}) const {
+		return detail::search_file(*this, in, fn, options);
+	}
+};
+
+} // namespace xtr
+
+
+#endif // SEARCH_HPP
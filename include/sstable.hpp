@@ -0,0 +1,530 @@
+#pragma once
+#ifndef SSTABLE_HPP
+#define SSTABLE_HPP
+
+
+#include "buffer_view.hpp"
+#include "cfile.hpp"
+#include "crc32.hpp"
+#include "hash.hpp"
+#include "platform.hpp"
+#include "varint.hpp"
+
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Sorted string tables: immutable files of key-value pairs in ascending key order.
+//
+// The file is a run of data blocks followed by a bloom filter, a block index and a fixed footer.
+// Within a block each entry stores the length of the prefix it shares with the previous key, the
+// lengths of the rest of the key and of the value as varints, then those bytes; every block starts
+// with a full key so it decodes on its own, and ends with a CRC-32 of its contents. The index holds
+// the last key, offset and size of every block. The footer holds the offsets and sizes of the
+// filter and index, the entry count and a magic number, as little-endian 64-bit integers.
+namespace sstable {
+
+constexpr std::uint64_t magic = 0x3162617473727478ull;
+constexpr std::size_t footer_size = 48;
+
+struct options {
+	std::size_t block_size = 4096;
+	std::size_t bits_per_key = 10;
+};
+
+namespace detail {
+
+[[nodiscard]] inline std::uint32_t load_u32(const char *data) noexcept {
+
+	std::uint32_t result = 0;
+
+	for (std::size_t i = 0; i < 4; ++i) {
+		result |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+	}
+
+	return result;
+}
+
+[[nodiscard]] inline std::uint64_t load_u64(const char *data) noexcept {
+	return load_u32(data) | static_cast<std::uint64_t>(load_u32(data + 4)) << 32;
+}
+
+inline void append_u32(std::string &output, std::uint32_t value) {
+
+	for (std::size_t i = 0; i < 4; ++i) {
+		output.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+	}
+}
+
+inline void append_varint(std::string &output, std::uint64_t value) {
+
+	char buffer[varint::max_size64];
+	output.append(buffer, varint::encode(value, buffer));
+}
+
+// Decodes a varint at input and advances past it; false if it is damaged
+inline bool read_varint(const char *&input, const char *end, std::uint64_t &value) noexcept {
+
+	std::size_t read = varint::decode(input, static_cast<std::size_t>(end - input), value);
+	input += read;
+
+	return read != 0;
+}
+
+// Bit positions come from two halves of one hash, the double hashing of Kirsch and Mitzenmacher
+[[nodiscard]] inline bool filter_contains(const std::string &filter, std::uint64_t hash) noexcept {
+
+	if (filter.size() < 2) {
+		return true;
+	}
+
+	std::size_t bits = 8 * (filter.size() - 1);
+	std::size_t probes = static_cast<unsigned char>(filter.back());
+	std::uint32_t position = static_cast<std::uint32_t>(hash);
+	std::uint32_t step = static_cast<std::uint32_t>(hash >> 32) | 1;
+
+	for (std::size_t i = 0; i < probes; ++i, position += step) {
+
+		std::size_t bit = position % bits;
+
+		if ((static_cast<unsigned char>(filter[bit / 8]) & (1u << (bit % 8))) == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // namespace detail
+
+// Writes a table from keys added in strictly ascending order. Each block goes to the cfile with a
+// single fwrite once it reaches the block size; the filter, index and footer are written by
+// finish(). The cfile is not owned and must outlive the writer.
+class writer {
+private:
+	cfile *m_file;
+	options m_options;
+	std::string m_block;
+	std::string m_last_key;
+	std::string m_index;
+	std::vector<std::uint64_t> m_hashes;
+	std::uint64_t m_offset;
+	std::uint64_t m_count;
+	bool m_error;
+
+	bool write_block() {
+
+		if (m_block.empty()) {
+			return true;
+		}
+
+		detail::append_u32(m_block, crc32(m_block.data(), m_block.size()));
+
+		if (m_file->fwrite(m_block.data(), 1, m_block.size()) != m_block.size()) {
+			m_error = true;
+			return false;
+		}
+
+		detail::append_varint(m_index, m_last_key.size());
+		m_index += m_last_key;
+		detail::append_varint(m_index, m_offset);
+		detail::append_varint(m_index, m_block.size());
+
+		m_offset += m_block.size();
+		m_block.clear();
+
+		return true;
+	}
+
+	[[nodiscard]] std::string make_filter() const {
+
+		std::size_t bits = m_hashes.size() * m_options.bits_per_key;
+		bits = bits < 64 ? 64 : (bits + 7) & ~std::size_t{7};
+
+		// ln 2 * bits per key probes minimises false positives
+		std::size_t probes = m_options.bits_per_key * 69 / 100;
+		probes = probes < 1 ? 1 : probes > 30 ? 30 : probes;
+
+		std::string result(bits / 8, '\0');
+
+		for (std::uint64_t hash : m_hashes) {
+
+			std::uint32_t position = static_cast<std::uint32_t>(hash);
+			std::uint32_t step = static_cast<std::uint32_t>(hash >> 32) | 1;
+
+			for (std::size_t i = 0; i < probes; ++i, position += step) {
+				std::size_t bit = position % bits;
+				result[bit / 8] = static_cast<char>(result[bit / 8] | (1 << (bit % 8)));
+			}
+		}
+
+		result.push_back(static_cast<char>(probes));
+
+		return result;
+	}
+
+public:
+	explicit writer(cfile &file, options settings = options{}) noexcept :
+	    m_file{&file}, m_options{settings}, m_offset{0}, m_count{0}, m_error{false} {
+
+		// Only a hint; add() reports running out of memory itself
+		try {
+			m_block.reserve(m_options.block_size + 64);
+		}
+		catch (const std::bad_alloc &) {
+		}
+	}
+
+	writer(const writer &) = delete;
+
+	writer &operator=(const writer &) = delete;
+
+	// Returns false on a write error or if memory runs out, after which the writer stays failed
+	bool add(buffer_view key, buffer_view value) noexcept {
+
+		assert(m_count == 0 || buffer_view(m_last_key.data(), m_last_key.size()) < key);
+
+		if (m_error) {
+			return false;
+		}
+
+		try {
+
+			std::size_t shared = 0;
+
+			if (!m_block.empty()) {
+
+				std::size_t limit = std::min(key.size(), m_last_key.size());
+
+				while (shared < limit && key[shared] == m_last_key[shared]) {
+					++shared;
+				}
+			}
+
+			detail::append_varint(m_block, shared);
+			detail::append_varint(m_block, key.size() - shared);
+			detail::append_varint(m_block, value.size());
+			m_block.append(key.data() + shared, key.size() - shared);
+			m_block.append(value.data(), value.size());
+
+			m_last_key.assign(key.data(), key.size());
+			m_hashes.push_back(hash_bytes(key.data(), key.size()));
+			++m_count;
+
+			return m_block.size() < m_options.block_size || write_block();
+		}
+		catch (const std::bad_alloc &) {
+			m_error = true;
+			return false;
+		}
+	}
+
+	// Writes the last block, the filter, the index and the footer. The table is complete once this
+	// returns true.
+	bool finish() noexcept {
+
+		if (m_error) {
+			return false;
+		}
+
+		try {
+
+			if (!write_block()) {
+				return false;
+			}
+
+			std::string filter = make_filter();
+			std::uint64_t footer[6] = {m_offset + filter.size(), m_index.size(), m_offset,
+			                           filter.size(),            m_count,        magic};
+
+			m_error = m_file->fwrite(filter.data(), 1, filter.size()) != filter.size()
+			          || m_file->fwrite(m_index.data(), 1, m_index.size()) != m_index.size()
+			          || m_file->write_le(footer, 6) != 6;
+		}
+		catch (const std::bad_alloc &) {
+			m_error = true;
+		}
+
+		return !m_error;
+	}
+
+	[[nodiscard]] std::uint64_t size() const noexcept {
+		return m_count;
+	}
+};
+
+// Reads a finished table through positional reads, so one reader may serve many threads at once.
+// open() loads the filter and block index into memory with a single read; after that a point
+// lookup costs at most one read of a data block, and filtered misses cost none. The cfile is not
+// owned and must outlive the reader.
+class reader {
+private:
+	cfile *m_file;
+	std::string m_filter;
+	std::vector<std::string> m_keys;
+	std::vector<std::uint64_t> m_offsets;
+	std::vector<std::uint32_t> m_sizes;
+	std::uint64_t m_count;
+
+	// Reads block index into output without its checksum, verifying it
+	bool read_block(std::size_t index, std::string &output) const {
+
+		std::uint32_t size = m_sizes[index];
+
+		output.resize(size);
+
+		if (size < 4 || platform::pread(*m_file, &output[0], size, m_offsets[index]) != size) {
+			return false;
+		}
+
+		std::uint32_t checksum = detail::load_u32(output.data() + size - 4);
+		output.resize(size - 4);
+
+		return crc32(output.data(), output.size()) == checksum;
+	}
+
+	// Calls function with each entry of the block from the first key not less than first, until
+	// it returns false, which sets stopped. Returns false if the block is damaged.
+	template <typename Function>
+	static bool scan_block(const std::string &block, buffer_view first, Function &function,
+	                       bool &stopped) {
+
+		std::string key;
+		const char *input = block.data();
+		const char *end = input + block.size();
+
+		stopped = false;
+
+		while (input != end) {
+
+			std::uint64_t shared;
+			std::uint64_t unshared;
+			std::uint64_t value_size;
+
+			if (!detail::read_varint(input, end, shared)
+			    || !detail::read_varint(input, end, unshared)
+			    || !detail::read_varint(input, end, value_size) || shared > key.size()
+			    || unshared > std::uint64_t(end - input)
+			    || value_size > std::uint64_t(end - input) - unshared) {
+				return false;
+			}
+
+			key.resize(static_cast<std::size_t>(shared));
+			key.append(input, static_cast<std::size_t>(unshared));
+			input += unshared;
+
+			buffer_view value{input, static_cast<std::size_t>(value_size)};
+			input += value_size;
+
+			if (!(buffer_view{key.data(), key.size()} < first)
+			    && !function(buffer_view{key.data(), key.size()}, value)) {
+				stopped = true;
+				return true;
+			}
+		}
+
+		return true;
+	}
+
+	// Index of the first block whose last key is not less than key
+	[[nodiscard]] std::size_t find_block(buffer_view key) const noexcept {
+
+		auto found = std::lower_bound(m_keys.begin(), m_keys.end(), key,
+		                              [](const std::string &lhs, buffer_view rhs) {
+			                              return buffer_view{lhs.data(), lhs.size()} < rhs;
+		                              });
+
+		return static_cast<std::size_t>(found - m_keys.begin());
+	}
+
+	// Reads the footer, then the filter and index together
+	bool load_metadata() {
+
+		std::uint64_t size = platform::file_size(*m_file);
+		char footer[footer_size];
+
+		if (size < footer_size
+		    || platform::pread(*m_file, footer, footer_size, size - footer_size) != footer_size
+		    || detail::load_u64(footer + 40) != magic) {
+			return false;
+		}
+
+		std::uint64_t index_offset = detail::load_u64(footer);
+		std::uint64_t index_size = detail::load_u64(footer + 8);
+		std::uint64_t filter_offset = detail::load_u64(footer + 16);
+		std::uint64_t filter_size = detail::load_u64(footer + 24);
+
+		// Each field is checked against the end of the index before any of them are added, so a
+		// damaged footer cannot wrap around
+		std::uint64_t limit = size - footer_size;
+
+		if (index_offset > limit || index_size != limit - index_offset
+		    || filter_offset > index_offset || filter_size != index_offset - filter_offset) {
+			return false;
+		}
+
+		std::string metadata(static_cast<std::size_t>(limit - filter_offset), '\0');
+
+		if (!metadata.empty()
+		    && platform::pread(*m_file, &metadata[0], metadata.size(), filter_offset)
+		           != metadata.size()) {
+			return false;
+		}
+
+		m_filter.assign(metadata, 0, static_cast<std::size_t>(filter_size));
+		m_keys.clear();
+		m_offsets.clear();
+		m_sizes.clear();
+
+		const char *input = metadata.data() + filter_size;
+		const char *end = metadata.data() + metadata.size();
+
+		while (input != end) {
+
+			std::uint64_t key_size;
+			std::uint64_t offset;
+			std::uint64_t block_size;
+
+			if (!detail::read_varint(input, end, key_size)
+			    || key_size > std::uint64_t(end - input)) {
+				return false;
+			}
+
+			m_keys.emplace_back(input, static_cast<std::size_t>(key_size));
+			input += key_size;
+
+			if (!detail::read_varint(input, end, offset)
+			    || !detail::read_varint(input, end, block_size) || block_size > 0xFFFFFFFF
+			    || offset > filter_offset || block_size > filter_offset - offset) {
+				return false;
+			}
+
+			m_offsets.push_back(offset);
+			m_sizes.push_back(static_cast<std::uint32_t>(block_size));
+		}
+
+		m_count = detail::load_u64(footer + 32);
+
+		return true;
+	}
+
+	// Looks the key up in the one block that may hold it
+	bool find_value(buffer_view key, std::string &value) const {
+
+		std::size_t index = find_block(key);
+		std::string block;
+		bool found = false;
+		bool stopped;
+
+		if (index == m_keys.size() || !read_block(index, block)) {
+			return false;
+		}
+
+		auto match = [&](buffer_view entry, buffer_view data) {
+
+			if (entry == key) {
+				value.assign(data.data(), data.size());
+				found = true;
+			}
+
+			return false;
+		};
+
+		return scan_block(block, key, match, stopped) && found;
+	}
+
+public:
+	explicit reader(cfile &file) noexcept : m_file{&file}, m_count{0} {}
+
+	// Returns false if the file is not a complete table or memory runs out
+	bool open() noexcept {
+
+		try {
+			return load_metadata();
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+	}
+
+	[[nodiscard]] std::uint64_t size() const noexcept {
+		return m_count;
+	}
+
+	// False if the key is certainly absent
+	[[nodiscard]] bool may_contain(buffer_view key) const noexcept {
+		return detail::filter_contains(m_filter, hash_bytes(key.data(), key.size()));
+	}
+
+	// Returns false if the key is absent, its block cannot be read or memory runs out
+	bool get(buffer_view key, std::string &value) const noexcept {
+
+		if (!may_contain(key)) {
+			return false;
+		}
+
+		try {
+			return find_value(key, value);
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+	}
+
+	// Calls function(key, value) for every entry with first <= key < last in key order, reading
+	// one block at a time. The views are valid only during the call. Returns false if a block
+	// could not be read or memory runs out.
+	template <typename Function>
+	bool scan(buffer_view first, buffer_view last, Function function) const {
+
+		bool stopped;
+		auto bounded = [&](buffer_view key, buffer_view value) {
+
+			if (!(key < last)) {
+				return false;
+			}
+
+			function(key, value);
+
+			return true;
+		};
+
+		try {
+
+			std::string block;
+
+			for (std::size_t index = find_block(first); index < m_keys.size(); ++index) {
+
+				if (!read_block(index, block) || !scan_block(block, first, bounded, stopped)) {
+					return false;
+				}
+
+				if (stopped) {
+					break;
+				}
+			}
+		}
+		catch (const std::bad_alloc &) {
+			return false;
+		}
+
+		return true;
+	}
+};
+
+} // namespace sstable
+
+} // namespace xtr
+
+
+#endif // SSTABLE_HPP
@@ -0,0 +1,124 @@
+#pragma once
+#ifndef TIMESTAMP_HPP
+#define TIMESTAMP_HPP
+
+
+#include "buffer_view.hpp"
+#include "cfile.hpp"
+#include "platform.hpp"
+
+#include <chrono>
+#include <string>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Formats timestamps for log lines. The part produced by strftime is rendered once per second and
+// cached; within the same second only the fractional digits are written, so localtime and strftime
+// run at most once a second instead of once a line. Not thread-safe: give each logging thread its
+// own formatter, for example a thread_local one.
+class timestamp_formatter {
+private:
+	using clock = std::chrono::system_clock;
+
+	std::string m_format;
+	char m_buffer[128];
+	std::size_t m_prefix_size;
+	std::int64_t m_second;
+	unsigned m_digits;
+	bool m_utc;
+
+	// Renders the strftime part for a new second. Returns false if it does not fit, leaving no
+	// second cached so that the next call tries again.
+	bool refresh(std::int64_t second) noexcept {
+
+		std::tm fields;
+
+		m_prefix_size = 0;
+		m_second = INT64_MIN;
+
+		if (!platform::calendar_time(static_cast<std::time_t>(second), fields, m_utc)) {
+			return false;
+		}
+
+		m_prefix_size = std::strftime(m_buffer, sizeof(m_buffer) - 10, m_format.c_str(), &fields);
+
+		if (m_prefix_size == 0) {
+			return false;
+		}
+
+		m_second = second;
+
+		return true;
+	}
+
+public:
+	// The format is passed to strftime; digits is the number of fractional second digits appended
+	// after a '.', up to 9, or 0 for none
+	explicit timestamp_formatter(const char *format = "%Y-%m-%d %H:%M:%S", unsigned digits = 6,
+	                             bool utc = false) :
+	    m_format{format}, m_prefix_size{0}, m_second{INT64_MIN}, m_digits{digits}, m_utc{utc} {
+		assert(digits <= 9);
+	}
+
+	// The view stays valid until the next call
+	[[nodiscard]] buffer_view format(clock::time_point time) noexcept {
+
+		auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		    time.time_since_epoch());
+		std::int64_t nanoseconds = since_epoch.count();
+		std::int64_t second = nanoseconds / 1000000000;
+		std::int64_t fraction = nanoseconds % 1000000000;
+
+		if (fraction < 0) {
+			fraction += 1000000000;
+			--second;
+		}
+
+		if (second != m_second && !refresh(second)) {
+			return buffer_view{m_buffer, 0};
+		}
+
+		if (m_digits == 0) {
+			return buffer_view{m_buffer, m_prefix_size};
+		}
+
+		for (unsigned i = m_digits; i < 9; ++i) {
+			fraction /= 10;
+		}
+
+		char *output = m_buffer + m_prefix_size;
+		output[0] = '.';
+
+		for (unsigned i = m_digits; i != 0; --i) {
+			output[i] = static_cast<char>('0' + fraction % 10);
+			fraction /= 10;
+		}
+
+		return buffer_view{m_buffer, m_prefix_size + 1 + m_digits};
+	}
+
+	[[nodiscard]] buffer_view now() noexcept {
+		return format(clock::now());
+	}
+
+	// Writes the current timestamp to the file, for use before an fprintf of the rest of the line
+	bool print(cfile &file) noexcept {
+
+		buffer_view text = now();
+
+		return file.fwrite(text.data(), 1, text.size()) == text.size();
+	}
+};
+
+} // namespace xtr
+
+
+#endif // TIMESTAMP_HPP
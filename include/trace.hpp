@@ -0,0 +1,593 @@
+#pragma once
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+
+#include "buffer_view.hpp"
+#include "cfile.hpp"
+#include "varint.hpp"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <cassert>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Binary trace events, encoded on the hot path and formatted only when decoded.
+//
+// The file is a run of chunks, one per flushed thread buffer. A chunk header holds the payload size
+// and the thread number as little-endian 32-bit integers and the timestamp of the first event in
+// nanoseconds as a little-endian 64-bit integer. Each event is the nanoseconds since the previous
+// event of the chunk and the event id as varints, then an argument count byte and the arguments,
+// each a type byte followed by a zigzag varint, a varint, eight little-endian bytes of a double or
+// a varint length and the bytes of a string. Event id 0 is reserved: its arguments are the id and
+// format string of an event definition.
+namespace trace {
+
+enum class arg_type : unsigned char
+{
+	signed_integer = 1,
+	unsigned_integer = 2,
+	floating = 3,
+	string = 4
+};
+
+constexpr std::size_t chunk_header_size = 16;
+constexpr std::size_t max_args = 255;
+
+namespace detail {
+
+inline void store_u32(char *output, std::uint32_t value) noexcept {
+
+	for (std::size_t i = 0; i < 4; ++i) {
+		output[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+	}
+}
+
+inline void store_u64(char *output, std::uint64_t value) noexcept {
+
+	store_u32(output, static_cast<std::uint32_t>(value));
+	store_u32(output + 4, static_cast<std::uint32_t>(value >> 32));
+}
+
+[[nodiscard]] inline std::uint64_t load_u64(const char *input) noexcept {
+
+	std::uint64_t result = 0;
+
+	for (std::size_t i = 0; i < 8; ++i) {
+		result |= static_cast<std::uint64_t>(static_cast<unsigned char>(input[i])) << (8 * i);
+	}
+
+	return result;
+}
+
+// Upper bound of the encoded size of each argument type. Only numbers take the fixed bound; a
+// char * must reach the string overload rather than match here exactly.
+template <typename Type,
+          typename std::enable_if<std::is_arithmetic<Type>::value, int>::type = 0>
+constexpr std::size_t max_arg_size(const Type &) noexcept {
+	return 1 + varint::max_size64;
+}
+
+inline std::size_t max_arg_size(buffer_view value) noexcept {
+	return 1 + varint::max_size64 + value.size();
+}
+
+inline std::size_t max_arg_size(const char *value) noexcept {
+	return 1 + varint::max_size64 + std::strlen(value);
+}
+
+inline std::size_t max_arg_size(const std::string &value) noexcept {
+	return 1 + varint::max_size64 + value.size();
+}
+
+template <typename Type, typename std::enable_if<std::is_integral<Type>::value
+                                                     && std::is_signed<Type>::value,
+                                                 int>::type = 0>
+char *encode_arg(char *output, Type value) noexcept {
+
+	*output++ = static_cast<char>(arg_type::signed_integer);
+
+	return output + varint::encode(varint::zigzag_encode(static_cast<std::int64_t>(value)), output);
+}
+
+template <typename Type, typename std::enable_if<std::is_integral<Type>::value
+                                                     && std::is_unsigned<Type>::value,
+                                                 int>::type = 0>
+char *encode_arg(char *output, Type value) noexcept {
+
+	*output++ = static_cast<char>(arg_type::unsigned_integer);
+
+	return output + varint::encode(static_cast<std::uint64_t>(value), output);
+}
+
+template <typename Type,
+          typename std::enable_if<std::is_floating_point<Type>::value, int>::type = 0>
+char *encode_arg(char *output, Type value) noexcept {
+
+	double converted = static_cast<double>(value);
+	std::uint64_t bits;
+	std::memcpy(&bits, &converted, sizeof(bits));
+
+	*output++ = static_cast<char>(arg_type::floating);
+	store_u64(output, bits);
+
+	return output + 8;
+}
+
+inline char *encode_arg(char *output, buffer_view value) noexcept {
+
+	*output++ = static_cast<char>(arg_type::string);
+	output += varint::encode(value.size(), output);
+
+	if (!value.empty()) {
+		std::memcpy(output, value.data(), value.size());
+	}
+
+	return output + value.size();
+}
+
+inline char *encode_arg(char *output, const char *value) noexcept {
+	return encode_arg(output, buffer_view{value});
+}
+
+inline char *encode_arg(char *output, const std::string &value) noexcept {
+	return encode_arg(output, buffer_view{value.data(), value.size()});
+}
+
+inline std::size_t sum_sizes() noexcept {
+	return 0;
+}
+
+template <typename First, typename... Rest>
+std::size_t sum_sizes(const First &first, const Rest &...rest) noexcept {
+	return max_arg_size(first) + sum_sizes(rest...);
+}
+
+inline char *encode_args(char *output) noexcept {
+	return output;
+}
+
+template <typename First, typename... Rest>
+char *encode_args(char *output, const First &first, const Rest &...rest) noexcept {
+
+	char *end = encode_arg(output, first);
+
+	// The buffer was only checked for the budgeted size
+	assert(static_cast<std::size_t>(end - output) <= max_arg_size(first));
+
+	return encode_args(end, rest...);
+}
+
+} // namespace detail
+
+[[nodiscard]] inline std::uint64_t now() noexcept {
+
+	auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+
+	return static_cast<std::uint64_t>(
+	    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+// Shared sink of the per-thread buffers. Each chunk reaches the cfile with a single fwrite under a
+// mutex, so chunks of different threads never interleave. The cfile is not owned and must outlive
+// the writer.
+class writer {
+private:
+	cfile *m_file;
+	std::mutex m_mutex;
+	std::uint32_t m_threads;
+	bool m_error;
+
+public:
+	explicit writer(cfile &file) noexcept : m_file{&file}, m_threads{0}, m_error{false} {}
+
+	writer(const writer &) = delete;
+
+	writer &operator=(const writer &) = delete;
+
+	// Writes a chunk whose payload follows chunk_header_size free bytes at data
+	bool write_chunk(char *data, std::size_t payload_size, std::uint32_t thread,
+	                 std::uint64_t timestamp) noexcept {
+
+		detail::store_u32(data, static_cast<std::uint32_t>(payload_size));
+		detail::store_u32(data + 4, thread);
+		detail::store_u64(data + 8, timestamp);
+
+		std::size_t size = chunk_header_size + payload_size;
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		m_error = m_error || m_file->fwrite(data, 1, size) != size;
+
+		return !m_error;
+	}
+
+	// Names an event id with a format string in which each {} stands for the next argument
+	bool define(std::uint32_t id, buffer_view format) noexcept {
+
+		assert(id != 0);
+
+		std::size_t capacity = chunk_header_size + 2 * varint::max_size64 + 1
+		                       + detail::sum_sizes(id, format);
+		std::unique_ptr<char[]> data{new (std::nothrow) char[capacity]};
+
+		if (data == nullptr) {
+			return false;
+		}
+
+		char *output = data.get() + chunk_header_size;
+
+		output += varint::encode(0, output);
+		output += varint::encode(0, output);
+		*output++ = 2;
+		output = detail::encode_args(output, id, format);
+
+		return write_chunk(data.get(), output - data.get() - chunk_header_size, 0, now());
+	}
+
+	[[nodiscard]] std::uint32_t next_thread() noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		return ++m_threads;
+	}
+
+	[[nodiscard]] bool error() noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		return m_error;
+	}
+};
+
+// Per-thread event buffer. Recording an event takes a clock reading and a few varint stores into
+// an owned buffer, with no locks; the buffer goes to the writer as one chunk when full, on flush()
+// and on destruction. Create one per thread; the writer must outlive it.
+class buffer {
+private:
+	writer *m_writer;
+	std::unique_ptr<char[]> m_data;
+	std::size_t m_capacity;
+	std::size_t m_size;
+	std::uint64_t m_first;
+	std::uint64_t m_last;
+	std::uint32_t m_thread;
+
+public:
+	static constexpr std::size_t default_capacity = 64 * 1024;
+	// Room for the chunk header and one event without arguments
+	static constexpr std::size_t min_capacity = chunk_header_size + 2 * varint::max_size64 + 1;
+
+	explicit buffer(writer &target, std::size_t capacity = default_capacity) noexcept :
+	    m_writer{&target},
+	    m_data{new (std::nothrow) char[capacity < min_capacity ? min_capacity : capacity]},
+	    m_capacity{m_data != nullptr ? (capacity < min_capacity ? min_capacity : capacity) : 0},
+	    m_size{chunk_header_size}, m_first{0}, m_last{0}, m_thread{target.next_thread()} {}
+
+	buffer(const buffer &) = delete;
+
+	buffer &operator=(const buffer &) = delete;
+
+	~buffer() {
+		flush();
+	}
+
+	// Records an event with integer, floating-point and string arguments. Returns false if the
+	// event does not fit in an empty buffer or a flush fails.
+	template <typename... Args>
+	bool event(std::uint32_t id, const Args &...args) noexcept {
+
+		static_assert(sizeof...(Args) <= max_args, "too many trace event arguments");
+
+		std::size_t needed = 2 * varint::max_size64 + 1 + detail::sum_sizes(args...);
+
+		// The size starts past the capacity when the buffer could not be allocated
+		if (m_size > m_capacity
+		    || (m_capacity - m_size < needed && (!flush() || m_capacity - m_size < needed))) {
+			return false;
+		}
+
+		std::uint64_t timestamp = now();
+
+		if (m_size == chunk_header_size) {
+			m_first = timestamp;
+			m_last = timestamp;
+		}
+
+		char *output = m_data.get() + m_size;
+
+		output += varint::encode(timestamp - m_last, output);
+		output += varint::encode(id, output);
+		*output++ = static_cast<char>(sizeof...(Args));
+		output = detail::encode_args(output, args...);
+
+		m_last = timestamp;
+		m_size = static_cast<std::size_t>(output - m_data.get());
+
+		return true;
+	}
+
+	// Hands buffered events to the writer; this does not call cfile::fflush
+	bool flush() noexcept {
+
+		if (m_size == chunk_header_size) {
+			return m_capacity != 0;
+		}
+
+		std::size_t size = m_size - chunk_header_size;
+		m_size = chunk_header_size;
+
+		return m_writer->write_chunk(m_data.get(), size, m_thread, m_first);
+	}
+};
+
+struct arg {
+	arg_type type;
+	std::int64_t signed_value;
+	std::uint64_t unsigned_value;
+	double floating_value;
+	std::string string_value;
+};
+
+struct event {
+	std::uint64_t timestamp;
+	std::uint32_t thread;
+	std::uint32_t id;
+	std::vector<arg> args;
+};
+
+// Decodes a trace file chunk by chunk. Definitions are collected as they are met, so format() can
+// render the events that follow them as text. The cfile is not owned and must outlive the decoder.
+class decoder {
+private:
+	cfile *m_file;
+	std::string m_chunk;
+	std::size_t m_position;
+	std::uint32_t m_thread;
+	std::uint64_t m_timestamp;
+	std::unordered_map<std::uint32_t, std::string> m_formats;
+	bool m_error;
+
+	bool read_varint(std::uint64_t &value) noexcept {
+
+		std::size_t read =
+		    varint::decode(m_chunk.data() + m_position, m_chunk.size() - m_position, value);
+
+		m_position += read;
+
+		return read != 0;
+	}
+
+	bool read_arg(arg &result) {
+
+		if (m_position == m_chunk.size()) {
+			return false;
+		}
+
+		result.type = static_cast<arg_type>(m_chunk[m_position++]);
+
+		switch (result.type) {
+		case arg_type::signed_integer:
+			if (!read_varint(result.unsigned_value)) {
+				return false;
+			}
+			result.signed_value = varint::zigzag_decode(result.unsigned_value);
+			return true;
+
+		case arg_type::unsigned_integer:
+			return read_varint(result.unsigned_value);
+
+		case arg_type::floating: {
+			if (m_chunk.size() - m_position < 8) {
+				return false;
+			}
+
+			std::uint64_t bits = detail::load_u64(m_chunk.data() + m_position);
+			std::memcpy(&result.floating_value, &bits, sizeof(bits));
+			m_position += 8;
+
+			return true;
+		}
+
+		case arg_type::string: {
+			std::uint64_t size;
+
+			if (!read_varint(size) || size > m_chunk.size() - m_position) {
+				return false;
+			}
+
+			result.string_value.assign(m_chunk, m_position, static_cast<std::size_t>(size));
+			m_position += static_cast<std::size_t>(size);
+
+			return true;
+		}
+		}
+
+		return false;
+	}
+
+	bool read_chunk() {
+
+		char header[chunk_header_size];
+
+		if (m_file->fread(header) != chunk_header_size) {
+			return false;
+		}
+
+		std::size_t size = static_cast<std::uint32_t>(detail::load_u64(header));
+
+		m_thread = static_cast<std::uint32_t>(detail::load_u64(header) >> 32);
+		m_timestamp = detail::load_u64(header + 8);
+		m_chunk.resize(size);
+		m_position = 0;
+
+		if (size != 0 && m_file->fread(&m_chunk[0], 1, size) != size) {
+			m_error = true;
+			return false;
+		}
+
+		return true;
+	}
+
+public:
+	explicit decoder(cfile &file) noexcept :
+	    m_file{&file}, m_position{0}, m_thread{0}, m_timestamp{0}, m_error{false} {}
+
+	// Decodes the next event, skipping definitions. Returns false at the end of the file or on
+	// damaged input.
+	bool next(event &result) {
+
+		for (;;) {
+
+			while (m_position == m_chunk.size()) {
+
+				if (!read_chunk()) {
+					return false;
+				}
+			}
+
+			std::uint64_t delta;
+			std::uint64_t id;
+
+			if (!read_varint(delta) || !read_varint(id) || m_position == m_chunk.size()) {
+				m_error = true;
+				return false;
+			}
+
+			std::size_t count = static_cast<unsigned char>(m_chunk[m_position++]);
+
+			m_timestamp += delta;
+			result.timestamp = m_timestamp;
+			result.thread = m_thread;
+			result.id = static_cast<std::uint32_t>(id);
+			result.args.resize(count);
+
+			for (arg &value : result.args) {
+
+				if (!read_arg(value)) {
+					m_error = true;
+					return false;
+				}
+			}
+
+			if (id != 0) {
+				return true;
+			}
+
+			if (count == 2 && result.args[0].type == arg_type::unsigned_integer
+			    && result.args[1].type == arg_type::string) {
+				m_formats[static_cast<std::uint32_t>(result.args[0].unsigned_value)] =
+				    std::move(result.args[1].string_value);
+			}
+		}
+	}
+
+	// Renders an event as "<timestamp> <thread> <text>", where the text is the defined format with
+	// each {} replaced by the next argument, or the event id and the arguments if it has none
+	void format(const event &value, std::string &output) const {
+
+		char number[64];
+
+		std::snprintf(number, sizeof(number), "%" PRIu64 " %" PRIu32 " ", value.timestamp,
+		              value.thread);
+		output = number;
+
+		auto append_arg = [&](const arg &item) {
+
+			switch (item.type) {
+			case arg_type::signed_integer:
+				std::snprintf(number, sizeof(number), "%" PRId64, item.signed_value);
+				output += number;
+				break;
+
+			case arg_type::unsigned_integer:
+				std::snprintf(number, sizeof(number), "%" PRIu64, item.unsigned_value);
+				output += number;
+				break;
+
+			case arg_type::floating:
+				std::snprintf(number, sizeof(number), "%g", item.floating_value);
+				output += number;
+				break;
+
+			case arg_type::string:
+				output += item.string_value;
+				break;
+			}
+		};
+
+		auto found = m_formats.find(value.id);
+		std::size_t next = 0;
+
+		if (found == m_formats.end()) {
+
+			std::snprintf(number, sizeof(number), "event %" PRIu32, value.id);
+			output += number;
+
+			for (const arg &item : value.args) {
+				output += ' ';
+				append_arg(item);
+			}
+
+			return;
+		}
+
+		const std::string &text = found->second;
+
+		for (std::size_t i = 0; i < text.size(); ++i) {
+
+			if (text[i] == '{' && i + 1 < text.size() && text[i + 1] == '}'
+			    && next < value.args.size()) {
+				append_arg(value.args[next++]);
+				++i;
+			}
+			else {
+				output += text[i];
+			}
+		}
+	}
+
+	// Writes every remaining event to output as a line of text
+	bool render(cfile &output) {
+
+		event value;
+		std::string line;
+
+		while (next(value)) {
+
+			format(value, line);
+			line += '\n';
+
+			if (output.fwrite(line.data(), 1, line.size()) != line.size()) {
+				return false;
+			}
+		}
+
+		return !error();
+	}
+
+	[[nodiscard]] bool error() noexcept {
+		return m_error || m_file->ferror() != 0;
+	}
+};
+
+} // namespace trace
+
+} // namespace xtr
+
+
+#endif // TRACE_HPP
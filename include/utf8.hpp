@@ -0,0 +1,451 @@
+#pragma once
+#ifndef UTF8_HPP
+#define UTF8_HPP
+
+
+#include "byte_scan.hpp"
+#include "cfile.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+
+// 'extra' namespace
+namespace xtr {
+
+#if defined(__SSSE3__)
+namespace detail {
+
+// Error classes of a byte and the one before it; a pair is invalid if all three lookups share a bit
+enum : unsigned char {
+	utf8_too_short = 1 << 0,         // 11______ followed by 0_______ or 11______
+	utf8_too_long = 1 << 1,          // 0_______ followed by 10______
+	utf8_overlong_3 = 1 << 2,        // 11100000 100_____
+	utf8_too_large = 1 << 3,         // 11110100 1001____ or 101_____, or 11110101 and above
+	utf8_surrogate = 1 << 4,         // 11101101 101_____
+	utf8_overlong_2 = 1 << 5,        // 1100000_ 10______
+	utf8_too_large_1000 = 1 << 6,    // 11110101 and above followed by 1000____
+	utf8_overlong_4 = 1 << 6,        // 11110000 1000____
+	utf8_two_continuations = 1 << 7, // 10______ 10______
+	utf8_carry = utf8_too_short | utf8_too_long | utf8_two_continuations
+};
+
+// Checks blocks of 16 bytes that start at a sequence boundary with the lookup method of Keiser and
+// Lemire: three shuffles classify every byte together with the one before it, and the bytes two
+// and three places back tell where a continuation byte is required. A sequence cut off by the end
+// of the last block is not an error here. Returns false if any other invalid sequence is found.
+[[nodiscard]] inline bool utf8_check_blocks(const char *data, std::size_t blocks) noexcept {
+
+	constexpr unsigned char large = utf8_carry | utf8_too_large | utf8_too_large_1000;
+	constexpr unsigned char continuation = utf8_too_long | utf8_overlong_2 | utf8_two_continuations;
+
+	// Indexed by the high nibble of the first byte: ASCII, continuation, then the four lead ranges
+	alignas(16) static const unsigned char first_high[16] = {
+	    utf8_too_long, utf8_too_long, utf8_too_long, utf8_too_long,
+	    utf8_too_long, utf8_too_long, utf8_too_long, utf8_too_long,
+	    utf8_two_continuations, utf8_two_continuations,
+	    utf8_two_continuations, utf8_two_continuations,
+	    utf8_too_short | utf8_overlong_2,
+	    utf8_too_short,
+	    utf8_too_short | utf8_overlong_3 | utf8_surrogate,
+	    utf8_too_short | utf8_too_large | utf8_too_large_1000 | utf8_overlong_4};
+
+	// Indexed by the low nibble of the first byte
+	alignas(16) static const unsigned char first_low[16] = {
+	    utf8_carry | utf8_overlong_3 | utf8_overlong_2 | utf8_overlong_4,
+	    utf8_carry | utf8_overlong_2,
+	    utf8_carry, utf8_carry,
+	    utf8_carry | utf8_too_large,
+	    large, large, large, large, large, large, large, large,
+	    large | utf8_surrogate,
+	    large, large};
+
+	// Indexed by the high nibble of the second byte: ASCII, four continuation ranges, then leads
+	alignas(16) static const unsigned char second_high[16] = {
+	    utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+	    utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short,
+	    continuation | utf8_overlong_3 | utf8_too_large_1000 | utf8_overlong_4,
+	    continuation | utf8_overlong_3 | utf8_too_large,
+	    continuation | utf8_surrogate | utf8_too_large,
+	    continuation | utf8_surrogate | utf8_too_large,
+	    utf8_too_short, utf8_too_short, utf8_too_short, utf8_too_short};
+
+	__m128i high_table = _mm_load_si128(reinterpret_cast<const __m128i *>(first_high));
+	__m128i low_table = _mm_load_si128(reinterpret_cast<const __m128i *>(first_low));
+	__m128i second_table = _mm_load_si128(reinterpret_cast<const __m128i *>(second_high));
+	__m128i nibble = _mm_set1_epi8(0x0F);
+	__m128i previous = _mm_setzero_si128();
+	__m128i error = _mm_setzero_si128();
+
+	for (std::size_t block = 0; block < blocks; ++block) {
+
+		__m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * block));
+		__m128i previous1 = _mm_alignr_epi8(input, previous, 15);
+		__m128i previous2 = _mm_alignr_epi8(input, previous, 14);
+		__m128i previous3 = _mm_alignr_epi8(input, previous, 13);
+
+		__m128i special = _mm_and_si128(
+		    _mm_and_si128(
+		        _mm_shuffle_epi8(high_table,
+		                         _mm_and_si128(_mm_srli_epi16(previous1, 4), nibble)),
+		        _mm_shuffle_epi8(low_table, _mm_and_si128(previous1, nibble))),
+		    _mm_shuffle_epi8(second_table, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+		// The high bit is set where a byte follows a three or four byte lead by two places, or a
+		// four byte lead by three; the lookups above expect exactly those to be continuations
+		__m128i required = _mm_and_si128(
+		    _mm_or_si128(_mm_subs_epu8(previous2, _mm_set1_epi8(0xE0 - 0x80)),
+		                 _mm_subs_epu8(previous3, _mm_set1_epi8(0xF0 - 0x80))),
+		    _mm_set1_epi8(static_cast<char>(0x80)));
+
+		error = _mm_or_si128(error, _mm_xor_si128(special, required));
+		previous = input;
+	}
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+} // namespace detail
+#endif
+
+namespace utf8 {
+
+// Incremental UTF-8 validator that accepts input in arbitrary pieces. Runs of ASCII are skipped a
+// vector at a time. With SSSE3 the rest is checked 16 bytes at a time by table lookups; otherwise
+// multi-byte sequences are checked byte by byte against the ranges of RFC 3629. Both reject
+// overlong forms, surrogates and code points above U+10FFFF.
+class validator {
+private:
+	unsigned char m_needed;
+	unsigned char m_lower;
+	unsigned char m_upper;
+	bool m_valid;
+
+public:
+	validator() noexcept : m_needed{0}, m_lower{0x80}, m_upper{0xBF}, m_valid{true} {}
+
+	// Returns false once any invalid sequence has been seen
+	bool update(const char *data, std::size_t size) noexcept {
+
+		std::size_t i = 0;
+
+		while (m_valid && i < size) {
+
+			if (m_needed == 0) {
+
+				i += detail::ascii_prefix(data + i, size - i);
+
+				if (i == size) {
+					break;
+				}
+
+#if defined(__SSSE3__)
+				std::size_t blocks = (size - i) / 16;
+
+				if (blocks != 0) {
+
+					if (!detail::utf8_check_blocks(data + i, blocks)) {
+						m_valid = false;
+						break;
+					}
+
+					// A sequence cut off by the last block is taken up again from its lead byte
+					std::size_t end = i + 16 * blocks;
+					i = end;
+
+					for (std::size_t back = 1; back <= 3; ++back) {
+
+						unsigned char byte = static_cast<unsigned char>(data[end - back]);
+
+						if (byte < 0x80) {
+							break;
+						}
+
+						if (byte >= 0xC0) {
+							std::size_t length = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : 2;
+							i = length > back ? end - back : end;
+							break;
+						}
+					}
+
+					continue;
+				}
+#endif
+			}
+
+			unsigned char byte = static_cast<unsigned char>(data[i++]);
+
+			if (m_needed != 0) {
+
+				if (byte < m_lower || byte > m_upper) {
+					m_valid = false;
+				}
+
+				--m_needed;
+				m_lower = 0x80;
+				m_upper = 0xBF;
+			}
+			else if (byte >= 0xC2 && byte <= 0xDF) {
+				m_needed = 1;
+			}
+			else if (byte >= 0xE0 && byte <= 0xEF) {
+				m_needed = 2;
+				m_lower = byte == 0xE0 ? 0xA0 : 0x80;
+				m_upper = byte == 0xED ? 0x9F : 0xBF;
+			}
+			else if (byte >= 0xF0 && byte <= 0xF4) {
+				m_needed = 3;
+				m_lower = byte == 0xF0 ? 0x90 : 0x80;
+				m_upper = byte == 0xF4 ? 0x8F : 0xBF;
+			}
+			else {
+				m_valid = false;
+			}
+		}
+
+		return m_valid;
+	}
+
+	[[nodiscard]] bool valid() const noexcept {
+		return m_valid;
+	}
+
+	// True if everything seen so far is valid and no sequence is left incomplete
+	[[nodiscard]] bool finish() const noexcept {
+		return m_valid && m_needed == 0;
+	}
+};
+
+[[nodiscard]] inline bool validate(const char *data, std::size_t size) noexcept {
+
+	validator result;
+	result.update(data, size);
+
+	return result.finish();
+}
+
+// Encodes a code point and returns the number of bytes written, at most four
+inline std::size_t encode(std::uint32_t code_point, char *output) noexcept {
+
+	if (code_point < 0x80) {
+		output[0] = static_cast<char>(code_point);
+		return 1;
+	}
+
+	if (code_point < 0x800) {
+		output[0] = static_cast<char>(0xC0 | (code_point >> 6));
+		output[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+		return 2;
+	}
+
+	if (code_point < 0x10000) {
+		output[0] = static_cast<char>(0xE0 | (code_point >> 12));
+		output[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+		output[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+		return 3;
+	}
+
+	output[0] = static_cast<char>(0xF0 | (code_point >> 18));
+	output[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+	output[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+	output[3] = static_cast<char>(0x80 | (code_point & 0x3F));
+	return 4;
+}
+
+constexpr std::uint32_t replacement_character = 0xFFFD;
+
+} // namespace utf8
+
+enum class text_encoding
+{
+	utf8,
+	utf16le,
+	utf16be,
+	latin1
+};
+
+// Text reader that always produces UTF-8. UTF-8 sources are validated chunk by chunk right after
+// each fread, while the bytes are still in cache, instead of in a separate pass. UTF-16 and
+// Latin-1 sources are read into the back of the caller's buffer and transcoded forward into the
+// same buffer; unpaired surrogates become U+FFFD and mark the input invalid. The cfile is not
+// owned and must outlive the reader.
+class utf8_reader {
+private:
+	cfile *m_file;
+	utf8::validator m_validator;
+	text_encoding m_encoding;
+	std::uint16_t m_high_surrogate;
+	bool m_has_odd_byte;
+	char m_odd_byte;
+	bool m_valid;
+
+	static constexpr std::size_t validate_chunk_size = 64 * 1024;
+
+	std::size_t read_utf8(char *buffer, std::size_t size) noexcept {
+
+		std::size_t result = 0;
+
+		while (result < size) {
+
+			std::size_t chunk = size - result < validate_chunk_size ? size - result
+			                                                        : validate_chunk_size;
+			std::size_t read = m_file->fread(buffer + result, 1, chunk);
+
+			m_validator.update(buffer + result, read);
+			result += read;
+
+			if (read != chunk) {
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	std::size_t read_latin1(char *buffer, std::size_t size) noexcept {
+
+		// Every input byte grows to at most two, so output never overtakes input read into the
+		// back half
+		std::size_t capacity = size / 2;
+		char *input = buffer + size - capacity;
+		std::size_t read = m_file->fread(input, 1, capacity);
+		std::size_t result = 0;
+
+		for (std::size_t i = 0; i < read;) {
+
+			std::size_t ascii = detail::ascii_prefix(input + i, read - i);
+
+			std::memmove(buffer + result, input + i, ascii);
+			result += ascii;
+			i += ascii;
+
+			if (i < read) {
+				result += utf8::encode(static_cast<unsigned char>(input[i++]), buffer + result);
+			}
+		}
+
+		return result;
+	}
+
+	std::size_t read_utf16(char *buffer, std::size_t size) noexcept {
+
+		// Every two input bytes grow to at most three, plus three bytes of slack for a high
+		// surrogate left over from the previous call
+		std::size_t capacity = (2 * (size - 3) / 3) & ~std::size_t{1};
+		char *input = buffer + size - capacity;
+		std::size_t carried = m_has_odd_byte ? 1 : 0;
+
+		input[0] = m_odd_byte;
+
+		std::size_t read = carried + m_file->fread(input + carried, 1, capacity - carried);
+
+		m_has_odd_byte = read % 2 != 0;
+
+		if (m_has_odd_byte) {
+			m_odd_byte = input[read - 1];
+		}
+
+		bool little_endian = m_encoding == text_encoding::utf16le;
+		std::size_t result = 0;
+
+		for (std::size_t i = 0; i + 1 < read; i += 2) {
+
+			unsigned first = static_cast<unsigned char>(input[i]);
+			unsigned second = static_cast<unsigned char>(input[i + 1]);
+			std::uint32_t unit = little_endian ? (second << 8) | first : (first << 8) | second;
+
+			if (m_high_surrogate != 0) {
+
+				if (unit >= 0xDC00 && unit <= 0xDFFF) {
+
+					std::uint32_t code_point =
+					    0x10000 + ((m_high_surrogate - 0xD800u) << 10) + (unit - 0xDC00);
+
+					result += utf8::encode(code_point, buffer + result);
+					m_high_surrogate = 0;
+
+					continue;
+				}
+
+				result += utf8::encode(utf8::replacement_character, buffer + result);
+				m_high_surrogate = 0;
+				m_valid = false;
+			}
+
+			if (unit >= 0xD800 && unit <= 0xDBFF) {
+				m_high_surrogate = static_cast<std::uint16_t>(unit);
+			}
+			else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+				result += utf8::encode(utf8::replacement_character, buffer + result);
+				m_valid = false;
+			}
+			else {
+				result += utf8::encode(unit, buffer + result);
+			}
+		}
+
+		return result;
+	}
+
+public:
+	explicit utf8_reader(cfile &file, text_encoding encoding = text_encoding::utf8) noexcept :
+	    m_file{&file}, m_encoding{encoding}, m_high_surrogate{0}, m_has_odd_byte{false},
+	    m_odd_byte{0}, m_valid{true} {}
+
+	// Reads UTF-8 text into buffer and returns the number of bytes stored. Transcoding sources
+	// need a buffer of at least 8 bytes and may return fewer bytes than requested before the end
+	// of the file; zero means end of file or a read error.
+	std::size_t read(char *buffer, std::size_t size) noexcept {
+
+		assert(m_encoding == text_encoding::utf8 || size >= 8);
+
+		// Too small to transcode into; also checked without asserts, since the transcoders
+		// compute their input area from size - 3
+		if (m_encoding != text_encoding::utf8 && size < 8) {
+			return 0;
+		}
+
+		std::size_t result = 0;
+
+		do {
+
+			switch (m_encoding) {
+			case text_encoding::utf8:
+				return read_utf8(buffer, size);
+
+			case text_encoding::latin1:
+				result = read_latin1(buffer, size);
+				break;
+
+			case text_encoding::utf16le:
+			case text_encoding::utf16be:
+				result = read_utf16(buffer, size);
+				break;
+			}
+
+		} while (result == 0 && m_file->feof() == 0 && m_file->ferror() == 0);
+
+		return result;
+	}
+
+	// False once invalid input has been seen
+	[[nodiscard]] bool valid() const noexcept {
+		return m_valid && m_validator.valid();
+	}
+
+	// Call at end of file: also fails if the input stopped in the middle of a character
+	[[nodiscard]] bool finish() const noexcept {
+		return valid() && m_validator.finish() && m_high_surrogate == 0 && !m_has_odd_byte;
+	}
+};
+
+} // namespace xtr
+
+
+#endif // UTF8_HPP
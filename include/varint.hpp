@@ -0,0 +1,488 @@
+#pragma once
+#ifndef VARINT_HPP
+#define VARINT_HPP
+
+
+#include "cfile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+
+// 'extra' namespace
+namespace xtr {
+
+// LEB128 variable-length integers: seven bits per byte, least significant group first, with the
+// high bit set on every byte except the last
+namespace varint {
+
+constexpr std::size_t max_size32 = 5;
+constexpr std::size_t max_size64 = 10;
+
+[[nodiscard]] inline std::size_t size(std::uint64_t value) noexcept {
+
+	std::size_t result = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		++result;
+	}
+
+	return result;
+}
+
+// Writes at most max_size64 bytes to output and returns the number written
+inline std::size_t encode(std::uint64_t value, char *output) noexcept {
+
+	std::size_t result = 0;
+
+	while (value >= 0x80) {
+		output[result++] = static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+
+	output[result++] = static_cast<char>(value);
+
+	return result;
+}
+
+// Returns the number of bytes read, or zero if the input is truncated or longer than a 64-bit value
+inline std::size_t decode(const char *input, std::size_t size, std::uint64_t &value) noexcept {
+
+	std::uint64_t result = 0;
+	std::size_t limit = size < max_size64 ? size : max_size64;
+
+	for (std::size_t i = 0; i < limit; ++i) {
+
+		std::uint64_t byte = static_cast<unsigned char>(input[i]);
+		result |= (byte & 0x7F) << (7 * i);
+
+		if ((byte & 0x80) == 0) {
+			value = result;
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+[[nodiscard]] inline std::uint32_t zigzag_encode(std::int32_t value) noexcept {
+	return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+}
+
+[[nodiscard]] inline std::uint64_t zigzag_encode(std::int64_t value) noexcept {
+	return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+[[nodiscard]] inline std::int32_t zigzag_decode(std::uint32_t value) noexcept {
+	return static_cast<std::int32_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+[[nodiscard]] inline std::int64_t zigzag_decode(std::uint64_t value) noexcept {
+	return static_cast<std::int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+// Stream VByte: 32-bit values are stored in groups of four behind one control byte holding the
+// byte length of each value, which lets the decoder expand a whole group with one byte shuffle
+
+[[nodiscard]] constexpr std::size_t stream_control_size(std::size_t count) noexcept {
+	return (count + 3) / 4;
+}
+
+// Padding a decoder needs after the data bytes, since the shuffle path loads 16 bytes at a time
+constexpr std::size_t stream_padding = 16;
+
+namespace detail {
+
+struct stream_tables {
+	unsigned char length[256];
+	unsigned char shuffle[256][16];
+};
+
+inline stream_tables make_stream_tables() noexcept {
+
+	stream_tables result{};
+
+	for (unsigned control = 0; control < 256; ++control) {
+
+		unsigned offset = 0;
+
+		for (unsigned i = 0; i < 4; ++i) {
+
+			unsigned length = ((control >> (2 * i)) & 3) + 1;
+
+			for (unsigned j = 0; j < 4; ++j) {
+				result.shuffle[control][4 * i + j] =
+				    static_cast<unsigned char>(j < length ? offset + j : 0x80);
+			}
+
+			offset += length;
+		}
+
+		result.length[control] = static_cast<unsigned char>(offset);
+	}
+
+	return result;
+}
+
+inline const stream_tables &get_stream_tables() noexcept {
+
+	static const stream_tables tables = make_stream_tables();
+
+	return tables;
+}
+
+} // namespace detail
+
+// Number of data bytes described by count values worth of control bytes
+[[nodiscard]] inline std::size_t stream_data_size(const char *control, std::size_t count) noexcept {
+
+	const detail::stream_tables &tables = detail::get_stream_tables();
+
+	std::size_t result = 0;
+	std::size_t full = count / 4;
+
+	for (std::size_t i = 0; i < full; ++i) {
+		result += tables.length[static_cast<unsigned char>(control[i])];
+	}
+
+	unsigned last = count % 4 != 0 ? static_cast<unsigned char>(control[full]) : 0;
+
+	for (std::size_t i = 0; i < count % 4; ++i) {
+		result += ((last >> (2 * i)) & 3) + 1;
+	}
+
+	return result;
+}
+
+// Writes stream_control_size(count) control bytes and at most 4 * count data bytes, returning the
+// number of data bytes
+inline std::size_t stream_encode(const std::uint32_t *values, std::size_t count, char *control,
+                                 char *data) noexcept {
+
+	std::size_t size = 0;
+
+	for (std::size_t i = 0; i < count; i += 4) {
+
+		unsigned bits = 0;
+		std::size_t group = count - i < 4 ? count - i : 4;
+
+		for (std::size_t j = 0; j < group; ++j) {
+
+			std::uint32_t value = values[i + j];
+			unsigned length = value < (1u << 8)    ? 1
+			                  : value < (1u << 16) ? 2
+			                  : value < (1u << 24) ? 3
+			                                       : 4;
+
+			for (unsigned k = 0; k < length; ++k) {
+				data[size++] = static_cast<char>((value >> (8 * k)) & 0xFF);
+			}
+
+			bits |= (length - 1) << (2 * j);
+		}
+
+		control[i / 4] = static_cast<char>(bits);
+	}
+
+	return size;
+}
+
+// Reads values encoded by stream_encode. The data buffer must be followed by stream_padding
+// readable bytes.
+inline void stream_decode(const char *control, const char *data, std::uint32_t *values,
+                          std::size_t count) noexcept {
+
+	const detail::stream_tables &tables = detail::get_stream_tables();
+
+	std::size_t index = 0;
+
+#if defined(__SSSE3__)
+	for (; index + 4 <= count; index += 4) {
+
+		unsigned bits = static_cast<unsigned char>(control[index / 4]);
+
+		__m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+		__m128i shuffle =
+		    _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables.shuffle[bits]));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(values + index),
+		                 _mm_shuffle_epi8(input, shuffle));
+
+		data += tables.length[bits];
+	}
+#else
+	(void)tables;
+#endif
+
+	for (; index < count; ++index) {
+
+		unsigned bits = static_cast<unsigned char>(control[index / 4]);
+		unsigned length = ((bits >> (2 * (index % 4))) & 3) + 1;
+		std::uint32_t value = 0;
+
+		for (unsigned k = 0; k < length; ++k) {
+			value |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[k])) << (8 * k);
+		}
+
+		values[index] = value;
+		data += length;
+	}
+}
+
+} // namespace varint
+
+namespace detail {
+
+constexpr std::size_t varint_block_size = 1024;
+
+// Encodes blocks of transformed values with Stream VByte, one fwrite per block
+template <typename Transform>
+std::size_t write_stream32(cfile &file, std::size_t count, Transform transform) noexcept {
+
+	std::uint32_t values[varint_block_size];
+	char buffer[varint::stream_control_size(varint_block_size) + 4 * varint_block_size];
+	std::size_t result = 0;
+
+	while (result < count) {
+
+		std::size_t size = count - result < varint_block_size ? count - result : varint_block_size;
+
+		for (std::size_t i = 0; i < size; ++i) {
+			values[i] = transform(result + i);
+		}
+
+		std::size_t control_size = varint::stream_control_size(size);
+		std::size_t total =
+		    control_size + varint::stream_encode(values, size, buffer, buffer + control_size);
+
+		if (file.fwrite(buffer, 1, total) != total) {
+			break;
+		}
+
+		result += size;
+	}
+
+	return result;
+}
+
+// Decodes blocks written by write_stream32 straight into values, then lets finish rewrite each
+// decoded block in place
+template <typename Finish>
+std::size_t read_stream32(cfile &file, std::uint32_t *values, std::size_t count,
+                          Finish finish) noexcept {
+
+	char control[varint::stream_control_size(varint_block_size)];
+	char data[4 * varint_block_size + varint::stream_padding];
+	std::size_t result = 0;
+
+	while (result < count) {
+
+		std::size_t size = count - result < varint_block_size ? count - result : varint_block_size;
+		std::size_t control_size = varint::stream_control_size(size);
+
+		if (file.fread(control, 1, control_size) != control_size) {
+			break;
+		}
+
+		std::size_t data_size = varint::stream_data_size(control, size);
+
+		if (file.fread(data, 1, data_size) != data_size) {
+			break;
+		}
+
+		std::memset(data + data_size, 0, varint::stream_padding);
+		varint::stream_decode(control, data, values + result, size);
+		finish(values + result, size);
+
+		result += size;
+	}
+
+	return result;
+}
+
+// 64-bit values use LEB128 blocks behind a little-endian 32-bit byte count
+template <typename Transform>
+std::size_t write_stream64(cfile &file, std::size_t count, Transform transform) noexcept {
+
+	char buffer[4 + varint::max_size64 * varint_block_size];
+	std::size_t result = 0;
+
+	while (result < count) {
+
+		std::size_t size = count - result < varint_block_size ? count - result : varint_block_size;
+		std::size_t total = 4;
+
+		for (std::size_t i = 0; i < size; ++i) {
+			total += varint::encode(transform(result + i), buffer + total);
+		}
+
+		for (std::size_t i = 0; i < 4; ++i) {
+			buffer[i] = static_cast<char>(((total - 4) >> (8 * i)) & 0xFF);
+		}
+
+		if (file.fwrite(buffer, 1, total) != total) {
+			break;
+		}
+
+		result += size;
+	}
+
+	return result;
+}
+
+template <typename Finish>
+std::size_t read_stream64(cfile &file, std::uint64_t *values, std::size_t count,
+                          Finish finish) noexcept {
+
+	char buffer[varint::max_size64 * varint_block_size];
+	std::size_t result = 0;
+
+	while (result < count) {
+
+		std::size_t size = count - result < varint_block_size ? count - result : varint_block_size;
+		std::uint32_t data_size = 0;
+
+		if (file.read_le(data_size) != 1 || data_size > sizeof(buffer)
+		    || file.fread(buffer, 1, data_size) != data_size) {
+			break;
+		}
+
+		std::size_t position = 0;
+		std::size_t decoded = 0;
+
+		for (; decoded < size; ++decoded) {
+
+			std::size_t length =
+			    varint::decode(buffer + position, data_size - position, values[result + decoded]);
+
+			if (length == 0) {
+				break;
+			}
+
+			position += length;
+		}
+
+		finish(values + result, decoded);
+		result += decoded;
+
+		if (decoded != size) {
+			break;
+		}
+	}
+
+	return result;
+}
+
+} // namespace detail
+
+// Integer streams. Each call writes count values in blocks and must be read back with the same
+// count; every function returns the number of values written or read.
+
+inline std::size_t write_varints(cfile &file, const std::uint32_t *values,
+                                 std::size_t count) noexcept {
+	return detail::write_stream32(file, count, [values](std::size_t i) { return values[i]; });
+}
+
+inline std::size_t read_varints(cfile &file, std::uint32_t *values, std::size_t count) noexcept {
+	return detail::read_stream32(file, values, count, [](std::uint32_t *, std::size_t) {});
+}
+
+// Signed values are zigzag coded so small negative numbers stay short
+inline std::size_t write_varints(cfile &file, const std::int32_t *values,
+                                 std::size_t count) noexcept {
+	return detail::write_stream32(
+	    file, count, [values](std::size_t i) { return varint::zigzag_encode(values[i]); });
+}
+
+inline std::size_t read_varints(cfile &file, std::int32_t *values, std::size_t count) noexcept {
+
+	return detail::read_stream32(file, reinterpret_cast<std::uint32_t *>(values), count,
+	                             [](std::uint32_t *block, std::size_t size) {
+		                             for (std::size_t i = 0; i < size; ++i) {
+			                             std::int32_t value = varint::zigzag_decode(block[i]);
+			                             std::memcpy(block + i, &value, sizeof(value));
+		                             }
+	                             });
+}
+
+inline std::size_t write_varints(cfile &file, const std::uint64_t *values,
+                                 std::size_t count) noexcept {
+	return detail::write_stream64(file, count, [values](std::size_t i) { return values[i]; });
+}
+
+inline std::size_t read_varints(cfile &file, std::uint64_t *values, std::size_t count) noexcept {
+	return detail::read_stream64(file, values, count, [](std::uint64_t *, std::size_t) {});
+}
+
+inline std::size_t write_varints(cfile &file, const std::int64_t *values,
+                                 std::size_t count) noexcept {
+	return detail::write_stream64(
+	    file, count, [values](std::size_t i) { return varint::zigzag_encode(values[i]); });
+}
+
+inline std::size_t read_varints(cfile &file, std::int64_t *values, std::size_t count) noexcept {
+
+	return detail::read_stream64(file, reinterpret_cast<std::uint64_t *>(values), count,
+	                             [](std::uint64_t *block, std::size_t size) {
+		                             for (std::size_t i = 0; i < size; ++i) {
+			                             std::int64_t value = varint::zigzag_decode(block[i]);
+			                             std::memcpy(block + i, &value, sizeof(value));
+		                             }
+	                             });
+}
+
+// Delta coding stores the difference to the previous value, which keeps sorted sequences such as
+// posting lists down to a byte or two per value. Differences wrap, so any sequence round-trips.
+
+inline std::size_t write_delta_varints(cfile &file, const std::uint32_t *values,
+                                       std::size_t count) noexcept {
+	return detail::write_stream32(file, count, [values](std::size_t i) {
+		return i == 0 ? values[0] : values[i] - values[i - 1];
+	});
+}
+
+inline std::size_t read_delta_varints(cfile &file, std::uint32_t *values,
+                                      std::size_t count) noexcept {
+
+	std::uint32_t previous = 0;
+
+	return detail::read_stream32(file, values, count,
+	                             [&previous](std::uint32_t *block, std::size_t size) {
+		                             for (std::size_t i = 0; i < size; ++i) {
+			                             previous += block[i];
+			                             block[i] = previous;
+		                             }
+	                             });
+}
+
+inline std::size_t write_delta_varints(cfile &file, const std::uint64_t *values,
+                                       std::size_t count) noexcept {
+	return detail::write_stream64(file, count, [values](std::size_t i) {
+		return i == 0 ? values[0] : values[i] - values[i - 1];
+	});
+}
+
+inline std::size_t read_delta_varints(cfile &file, std::uint64_t *values,
+                                      std::size_t count) noexcept {
+
+	std::uint64_t previous = 0;
+
+	return detail::read_stream64(file, values, count,
+	                             [&previous](std::uint64_t *block, std::size_t size) {
+		                             for (std::size_t i = 0; i < size; ++i) {
+			                             previous += block[i];
+			                             block[i] = previous;
+		                             }
+	                             });
+}
+
+} // namespace xtr
+
+
+#endif // VARINT_HPP
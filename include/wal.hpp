@@ -0,0 +1,199 @@
+#pragma once
+#ifndef WAL_HPP
+#define WAL_HPP
+
+
+#include "buffer_view.hpp"
+#include "buffered_reader.hpp"
+#include "cfile.hpp"
+#include "crc32.hpp"
+#include "platform.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+
+
+// 'extra' namespace
+namespace xtr {
+
+// Write-ahead log with group commit. Each record is framed as its size and a CRC-32 of its bytes,
+// both little-endian 32-bit integers, followed by the bytes. Appending threads queue their records
+// and wait; whichever thread finds no commit in progress becomes the leader, writes everything
+// queued so far with one fwrite and one sync, and wakes every thread whose record it covered.
+// Records queued while a leader syncs go out together in the next batch, so the sync cost is
+// shared by all concurrent commits. The cfile should be opened with mode::append | mode::binary;
+// it is not owned and must outlive the log.
+class wal {
+private:
+	cfile *m_file;
+	std::mutex m_mutex;
+	std::condition_variable m_committed;
+	std::string m_pending;
+	std::uint64_t m_appended;
+	std::uint64_t m_durable;
+	std::size_t m_max_record_size;
+	bool m_leader;
+	bool m_sync;
+	bool m_error;
+
+	static void append_u32(std::string &output, std::uint32_t value) {
+
+		for (std::size_t i = 0; i < 4; ++i) {
+			output.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+		}
+	}
+
+	[[nodiscard]] static std::uint32_t load_u32(const char *data) noexcept {
+
+		std::uint32_t result = 0;
+
+		for (std::size_t i = 0; i < 4; ++i) {
+			result |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+		}
+
+		return result;
+	}
+
+public:
+	static constexpr std::size_t header_size = 8;
+	static constexpr std::size_t default_max_record_size = 64 * 1024 * 1024;
+
+	// With sync disabled a commit only reaches the operating system, which survives a process
+	// crash but not a power failure. Records above max_record_size bytes are refused; it must not
+	// exceed the limit later passed to recover, which treats larger sizes as a torn tail.
+	explicit wal(cfile &file, bool sync = true,
+	             std::size_t max_record_size = default_max_record_size) noexcept :
+	    m_file{&file}, m_appended{0}, m_durable{0},
+	    m_max_record_size{max_record_size < 0xFFFFFFFF ? max_record_size : 0xFFFFFFFF},
+	    m_leader{false}, m_sync{sync}, m_error{false} {}
+
+	wal(const wal &) = delete;
+
+	wal &operator=(const wal &) = delete;
+
+	// Appends a record and returns once it is durable. Safe to call from any number of threads.
+	// Returns false if this or any earlier batch failed to write; the log accepts no more records
+	// after a failure. A record above the maximum size is refused without affecting the log.
+	bool append(buffer_view record) {
+
+		if (record.size() > m_max_record_size) {
+			return false;
+		}
+
+		std::unique_lock<std::mutex> lock{m_mutex};
+
+		if (m_error) {
+			return false;
+		}
+
+		append_u32(m_pending, static_cast<std::uint32_t>(record.size()));
+		append_u32(m_pending, crc32(record.data(), record.size()));
+		m_pending.append(record.data(), record.size());
+
+		std::uint64_t sequence = ++m_appended;
+
+		while (m_durable < sequence && !m_error) {
+
+			if (m_leader) {
+				m_committed.wait(lock);
+				continue;
+			}
+
+			m_leader = true;
+
+			std::string batch;
+			batch.swap(m_pending);
+			std::uint64_t last = m_appended;
+
+			lock.unlock();
+
+			bool written = m_file->fwrite(batch.data(), 1, batch.size()) == batch.size()
+			               && (m_sync ? platform::sync(*m_file) : m_file->fflush() == 0);
+
+			lock.lock();
+
+			m_leader = false;
+			m_error = m_error || !written;
+			m_durable = last;
+
+			// Hand the drained buffer back so the next batch reuses its capacity
+			if (m_pending.empty()) {
+				batch.clear();
+				m_pending.swap(batch);
+			}
+
+			m_committed.notify_all();
+		}
+
+		return !m_error;
+	}
+
+	[[nodiscard]] bool error() noexcept {
+
+		std::lock_guard<std::mutex> lock{m_mutex};
+
+		return m_error;
+	}
+
+	// Calls function with every intact record of the log at filename in order, then cuts off a
+	// torn or damaged tail so new records follow the last good one. Run before opening the log for
+	// appending. A missing file counts as an empty log. Returns false on a read or truncate error.
+	template <typename Function>
+	static bool recover(const char *filename, Function function,
+	                    std::size_t max_record_size = default_max_record_size) {
+
+		cfile file{filename, mode::read | mode::binary | mode::extended};
+
+		if (file == nullptr) {
+			return !platform::exists(filename);
+		}
+
+		std::uint64_t valid = 0;
+
+		{
+			buffered_reader reader{file};
+
+			for (;;) {
+
+				buffer_view header = reader.peek(header_size);
+
+				if (header.size() < header_size) {
+					break;
+				}
+
+				std::size_t size = load_u32(header.data());
+
+				if (size > max_record_size) {
+					break;
+				}
+
+				buffer_view frame = reader.peek(header_size + size);
+
+				if (frame.size() < header_size + size
+				    || crc32(frame.data() + header_size, size) != load_u32(frame.data() + 4)) {
+					break;
+				}
+
+				function(buffer_view{frame.data() + header_size, size});
+				reader.consume(header_size + size);
+				valid += header_size + size;
+			}
+
+			if (reader.error()) {
+				return false;
+			}
+		}
+
+		return valid == platform::file_size(file) || platform::truncate(file, valid);
+	}
+};
+
+} // namespace xtr
+
+
+#endif // WAL_HPP